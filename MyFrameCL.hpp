@@ -1,10 +1,38 @@
+#pragma once
+
 #include <iostream>
 #include <sstream>
 #include <vector>
 #include <fstream>
 #include <list>
+#include <map>
+#include <tuple>
+#include <type_traits>
+#include <array>
+#include <utility>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <string_view>
+#include <iterator>
+#include <cstdint>
+#include <algorithm>
+#include <new>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <cstdio>
 #include <CL/cl.h>
 
+#ifdef MYFCL_FAKE_CL
+#include "fakecl.hpp" // recording host backend instead of an OpenCL runtime
+#endif
+
 #define CHECK_ERR(RET, N) if(RET != CL_SUCCESS) throw(Exception(#N, RET, __LINE__, __FILE__));
 namespace myfcl{
 
@@ -26,6 +54,425 @@ struct Exception: public std::runtime_error{
 	};
 };
 
+enum { HOST_ALIGNMENT = 4096 }; // page, covers CL_DEVICE_MEM_BASE_ADDR_ALIGN of known devices
+
+template<typename T>
+struct AlignedAllocator{
+
+	// Allocates host memory on HOST_ALIGNMENT boundary, so buffers can be transferred
+	// or mapped by devices without intermediate staging copies
+
+	using value_type = T;
+
+	AlignedAllocator() = default;
+
+	template<typename U>
+	AlignedAllocator(AlignedAllocator<U> const&){};
+
+	T* allocate(size_t n){
+		return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{HOST_ALIGNMENT}));
+	}
+
+	void deallocate(T* p, size_t){
+		::operator delete(p, std::align_val_t{HOST_ALIGNMENT});
+	}
+
+	template<typename U>
+	bool operator==(AlignedAllocator<U> const&) const{
+		return true;
+	}
+};
+
+template<typename T>
+using aligned_vector = std::vector<T, AlignedAllocator<T>>;
+
+// Runtime metrics: relaxed atomic counters updated by tasks, kernels, programs and buffers.
+// Counting costs an uncontended atomic add per transfer or launch; the per kernel counter
+// is looked up once, when a Kernel is created.
+
+struct MetricsSnapshot{
+	uint64_t bytes_to_device;
+	uint64_t bytes_to_host;
+	uint64_t bytes_on_device; // device to device copies
+	uint64_t transfers_to_device;
+	uint64_t transfers_to_host;
+	uint64_t launches;
+	uint64_t program_builds;
+	uint64_t build_ns;
+	uint64_t buffer_allocations;
+	uint64_t buffer_bytes;
+	uint64_t host_wait_ns; // blocking transfers and clFinish
+	std::map<std::string, uint64_t> kernel_launches;
+
+	std::string text() const{
+
+		// Prometheus text exposition format
+
+		std::stringstream ss;
+
+		auto counter = [&](const char* name, auto value){
+			ss << "# TYPE myfcl_" << name << " counter" << std::endl << "myfcl_" << name << " " << value << std::endl;
+		};
+
+		counter("bytes_to_device_total", bytes_to_device);
+		counter("bytes_to_host_total", bytes_to_host);
+		counter("bytes_on_device_total", bytes_on_device);
+		counter("transfers_to_device_total", transfers_to_device);
+		counter("transfers_to_host_total", transfers_to_host);
+		counter("launches_total", launches);
+		counter("program_builds_total", program_builds);
+		counter("build_seconds_total", build_ns * 1e-9);
+		counter("buffer_allocations_total", buffer_allocations);
+		counter("buffer_bytes_total", buffer_bytes);
+		counter("host_wait_seconds_total", host_wait_ns * 1e-9);
+
+		ss << "# TYPE myfcl_kernel_launches_total counter" << std::endl;
+
+		for(auto const& [kernel, count]: kernel_launches)
+			ss << "myfcl_kernel_launches_total{kernel=\"" << kernel << "\"} " << count << std::endl;
+
+		return ss.str();
+	}
+};
+
+class Metrics{
+
+	using Counter = std::atomic<uint64_t>;
+
+	Counter bytes_to_device_{0}, bytes_to_host_{0}, bytes_on_device_{0};
+	Counter transfers_to_device_{0}, transfers_to_host_{0};
+	Counter launches_{0};
+	Counter program_builds_{0}, build_ns_{0};
+	Counter buffer_allocations_{0}, buffer_bytes_{0};
+	Counter host_wait_ns_{0};
+
+	mutable std::mutex kernels_mutex_;
+	std::map<std::string, Counter> kernel_launches_; // nodes never move, counters are handed out by pointer
+
+	static void add(Counter& counter, uint64_t value){
+		counter.fetch_add(value, std::memory_order_relaxed);
+	}
+
+public:
+
+	void toDevice(size_t bytes){
+		add(bytes_to_device_, bytes);
+		add(transfers_to_device_, 1);
+	}
+
+	void toHost(size_t bytes){
+		add(bytes_to_host_, bytes);
+		add(transfers_to_host_, 1);
+	}
+
+	void onDevice(size_t bytes){
+		add(bytes_on_device_, bytes);
+	}
+
+	void launch(Counter* kernel_counter){
+		add(launches_, 1);
+		add(*kernel_counter, 1);
+	}
+
+	void build(uint64_t ns){
+		add(program_builds_, 1);
+		add(build_ns_, ns);
+	}
+
+	void allocation(size_t bytes){
+		add(buffer_allocations_, 1);
+		add(buffer_bytes_, bytes);
+	}
+
+	void hostWait(uint64_t ns){
+		add(host_wait_ns_, ns);
+	}
+
+	Counter* kernelCounter(std::string const& name){
+		std::lock_guard<std::mutex> lock{kernels_mutex_};
+		return &kernel_launches_.try_emplace(name, 0).first->second;
+	}
+
+	MetricsSnapshot snapshot() const{
+
+		// Counters are read one by one, a snapshot taken under load isn't a single point in time
+
+		MetricsSnapshot ret{bytes_to_device_.load(), bytes_to_host_.load(), bytes_on_device_.load(),
+			transfers_to_device_.load(), transfers_to_host_.load(), launches_.load(),
+			program_builds_.load(), build_ns_.load(), buffer_allocations_.load(), buffer_bytes_.load(),
+			host_wait_ns_.load(), {}};
+
+		std::lock_guard<std::mutex> lock{kernels_mutex_};
+
+		for(auto const& [kernel, count]: kernel_launches_)
+			ret.kernel_launches.emplace(kernel, count.load());
+
+		return ret;
+	}
+
+	MetricsSnapshot reset(){
+
+		// Returns counts accumulated since the previous reset
+
+		MetricsSnapshot ret{bytes_to_device_.exchange(0), bytes_to_host_.exchange(0), bytes_on_device_.exchange(0),
+			transfers_to_device_.exchange(0), transfers_to_host_.exchange(0), launches_.exchange(0),
+			program_builds_.exchange(0), build_ns_.exchange(0), buffer_allocations_.exchange(0), buffer_bytes_.exchange(0),
+			host_wait_ns_.exchange(0), {}};
+
+		std::lock_guard<std::mutex> lock{kernels_mutex_};
+
+		for(auto& [kernel, count]: kernel_launches_)
+			ret.kernel_launches.emplace(kernel, count.exchange(0));
+
+		return ret;
+	}
+};
+
+inline Metrics& metrics(){
+	static Metrics instance;
+	return instance;
+}
+
+struct HostWait{
+
+	// Adds its lifetime to host wait time
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	~HostWait(){
+		metrics().hostWait(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+	}
+};
+
+inline cl_int waitQueue(cl_command_queue queue){
+	HostWait wait;
+	return clFinish(queue);
+}
+
+class MetricsDump{
+
+	// Rewrites path with a metrics snapshot every period, the file is replaced
+	// by rename so a scraper never sees it half-written
+
+	std::string path_;
+	std::chrono::milliseconds period_;
+
+	std::mutex mutex_;
+	std::condition_variable stop_cv_;
+	bool stop_ = false;
+
+	std::thread thread_;
+
+	void write(){
+		std::string tmp = path_ + ".tmp";
+		{
+			std::ofstream file{tmp, std::ios::trunc};
+			file << metrics().snapshot().text();
+		}
+		std::rename(tmp.c_str(), path_.c_str());
+	}
+
+public:
+
+	MetricsDump(std::string path, std::chrono::milliseconds period): path_(std::move(path)), period_(period){
+		thread_ = std::thread([this]{
+			std::unique_lock<std::mutex> lock{mutex_};
+
+			while(!stop_cv_.wait_for(lock, period_, [this]{ return stop_; }))
+				write();
+		});
+	}
+
+	MetricsDump(MetricsDump const&) = delete;
+
+	MetricsDump& operator=(MetricsDump const&) = delete;
+
+	~MetricsDump(){
+		{
+			std::lock_guard<std::mutex> lock{mutex_};
+			stop_ = true;
+		}
+
+		stop_cv_.notify_all();
+		thread_.join();
+
+		write(); // final values
+	}
+};
+
+// Device capabilities are queried once per process and shared by the whole framework
+
+template<typename T>
+T deviceParam(cl_device_id dev, cl_device_info param){
+	T value;
+	cl_int ret = clGetDeviceInfo(dev, param, sizeof(value), &value, NULL);
+	CHECK_ERR(ret, clGetDeviceInfo);
+	return value;
+}
+
+inline std::string deviceString(cl_device_id dev, cl_device_info param){
+	size_t length;
+	cl_int ret = clGetDeviceInfo(dev, param, 0, NULL, &length);
+	CHECK_ERR(ret, clGetDeviceInfo);
+
+	std::string value(length, '\0');
+	ret = clGetDeviceInfo(dev, param, length, value.data(), NULL);
+	CHECK_ERR(ret, clGetDeviceInfo);
+
+	value.resize(std::strlen(value.c_str()));
+	return value;
+}
+
+struct DeviceInfo{
+	cl_device_id id;
+	cl_platform_id platform;
+	std::string name, vendor, extensions;
+	cl_device_type type;
+	cl_uint compute_units, clock_mhz;
+	size_t max_work_group_size;
+	std::vector<size_t> max_work_item_sizes;
+	cl_ulong local_mem, global_mem, max_alloc;
+	size_t base_addr_align; // in bytes
+	cl_command_queue_properties queue_properties;
+	bool fp64;
+
+	DeviceInfo(cl_device_id dev, cl_platform_id plat): id(dev), platform(plat){
+		name = deviceString(dev, CL_DEVICE_NAME);
+		vendor = deviceString(dev, CL_DEVICE_VENDOR);
+		extensions = deviceString(dev, CL_DEVICE_EXTENSIONS);
+		type = deviceParam<cl_device_type>(dev, CL_DEVICE_TYPE);
+		compute_units = deviceParam<cl_uint>(dev, CL_DEVICE_MAX_COMPUTE_UNITS);
+		clock_mhz = deviceParam<cl_uint>(dev, CL_DEVICE_MAX_CLOCK_FREQUENCY);
+		max_work_group_size = deviceParam<size_t>(dev, CL_DEVICE_MAX_WORK_GROUP_SIZE);
+
+		max_work_item_sizes.resize(deviceParam<cl_uint>(dev, CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS));
+		cl_int ret = clGetDeviceInfo(dev, CL_DEVICE_MAX_WORK_ITEM_SIZES, max_work_item_sizes.size() * sizeof(size_t), max_work_item_sizes.data(), NULL);
+		CHECK_ERR(ret, clGetDeviceInfo);
+
+		local_mem = deviceParam<cl_ulong>(dev, CL_DEVICE_LOCAL_MEM_SIZE);
+		global_mem = deviceParam<cl_ulong>(dev, CL_DEVICE_GLOBAL_MEM_SIZE);
+		max_alloc = deviceParam<cl_ulong>(dev, CL_DEVICE_MAX_MEM_ALLOC_SIZE);
+		base_addr_align = deviceParam<cl_uint>(dev, CL_DEVICE_MEM_BASE_ADDR_ALIGN) / 8;
+		queue_properties = deviceParam<cl_command_queue_properties>(dev, CL_DEVICE_QUEUE_PROPERTIES);
+		fp64 = extensions.find("cl_khr_fp64") != std::string::npos;
+	}
+
+	double score() const{
+
+		// Rough throughput estimate: compute units x clock, up to twice as much for
+		// memory size (full bonus at 16 GiB) and a small bonus for double precision
+
+		double memory_gib = static_cast<double>(global_mem) / (1ull << 30);
+
+		return static_cast<double>(compute_units) * clock_mhz * (1 + std::min(memory_gib, 16.0) / 16) * (fp64 ? 1.1 : 1);
+	}
+};
+
+struct PlatformInfo{
+	cl_platform_id id;
+	std::string name, vendor;
+};
+
+struct Capabilities{
+	std::vector<PlatformInfo> platforms;
+	std::vector<DeviceInfo> devices; // of all platforms
+};
+
+inline Capabilities const& capabilities(){
+
+	// Snapshot of every platform and device, taken on the first call
+
+	static Capabilities const snapshot = []{
+		Capabilities ret;
+
+		cl_uint n_platforms;
+
+		cl_int err = clGetPlatformIDs(0, NULL, &n_platforms);
+		CHECK_ERR(err, clGetPlatformIDs);
+
+		std::vector<cl_platform_id> platforms(n_platforms);
+
+		err = clGetPlatformIDs(n_platforms, platforms.data(), NULL);
+		CHECK_ERR(err, clGetPlatformIDs);
+
+		for(auto pid: platforms){
+			PlatformInfo plat{pid, {}, {}};
+
+			for(auto [param, value]: {std::pair{CL_PLATFORM_NAME, &plat.name}, std::pair{CL_PLATFORM_VENDOR, &plat.vendor}}){
+				size_t length;
+				err = clGetPlatformInfo(pid, param, 0, NULL, &length);
+				CHECK_ERR(err, clGetPlatformInfo);
+
+				value->resize(length);
+				err = clGetPlatformInfo(pid, param, length, value->data(), NULL);
+				CHECK_ERR(err, clGetPlatformInfo);
+
+				value->resize(std::strlen(value->c_str()));
+			}
+
+			ret.platforms.push_back(plat);
+
+			cl_uint n_devices;
+
+			err = clGetDeviceIDs(pid, CL_DEVICE_TYPE_ALL, 0, NULL, &n_devices);
+
+			if(err == CL_DEVICE_NOT_FOUND)
+				continue;
+
+			CHECK_ERR(err, clGetDeviceIDs);
+
+			std::vector<cl_device_id> devices(n_devices);
+
+			err = clGetDeviceIDs(pid, CL_DEVICE_TYPE_ALL, n_devices, devices.data(), NULL);
+			CHECK_ERR(err, clGetDeviceIDs);
+
+			for(auto dev: devices)
+				ret.devices.emplace_back(dev, pid);
+		}
+
+		return ret;
+	}();
+
+	return snapshot;
+}
+
+inline DeviceInfo const& deviceInfo(cl_device_id dev){
+
+	// Capabilities of dev, devices created later (sub-devices) are queried on first use and kept
+
+	for(auto const& info: capabilities().devices)
+		if(info.id == dev)
+			return info;
+
+	static std::map<cl_device_id, DeviceInfo> created;
+	static std::mutex created_mutex;
+
+	std::lock_guard<std::mutex> lock{created_mutex};
+
+	auto found = created.find(dev);
+
+	if(found == created.end())
+		found = created.emplace(dev, DeviceInfo{dev, deviceParam<cl_platform_id>(dev, CL_DEVICE_PLATFORM)}).first;
+
+	return found->second;
+}
+
+inline DeviceInfo const& bestDevice(cl_device_type dtype = CL_DEVICE_TYPE_ALL, bool need_fp64 = false){
+
+	// Highest scoring device of the given type among all platforms
+
+	DeviceInfo const* best = nullptr;
+
+	for(auto const& info: capabilities().devices)
+		if((info.type & dtype) && (info.fp64 || !need_fp64) && (!best || info.score() > best->score()))
+			best = &info;
+
+	if(!best)
+		throw(Exception{"No device matches requested type"});
+
+	return *best;
+}
+
 class Platform{
 protected:
 	cl_platform_id pid;
@@ -54,65 +501,122 @@ public:
 	}
 
 	Platform(const char* platform_name){
-		//Getting platforms info
-		cl_uint n_platforms;
-   		
-   		cl_int ret = clGetPlatformIDs(0, NULL, &n_platforms);
-   		
-   		CHECK_ERR(ret, clGetPlatformIDs);
-
-    	std::vector<cl_platform_id> platforms;
-    	
-    	platforms.reserve(10);
-
-    	ret = clGetPlatformIDs(n_platforms, platforms.data(), NULL);
-  		
-   		CHECK_ERR(ret, clGetPlatformIDs);
+
+		// First platform whose name or vendor starts with platform_name, from the capability snapshot
+
 #ifdef SHOW_OCL_INFO
  
    		std::cout << "Avaible platforms info:" << std::endl << std::endl;
 
-   		for(int i = 0; i < n_platforms; i++){
-   			std::cout << "Plat id " << platforms[i] << ":" << std::endl;
-   			printInfo(platforms[i]);
+   		for(auto const& plat: capabilities().platforms){
+   			std::cout << "Plat id " << plat.id << ":" << std::endl;
+   			printInfo(plat.id);
    		}
 #endif
 
-   		for(int i = 0; i < n_platforms; i++){
-   			std::string plat_name, vendor_name;
+   		for(auto const& plat: capabilities().platforms){
+			if(plat.name.starts_with(platform_name) || plat.vendor.starts_with(platform_name)){
+   				std::cout << "Choosen platform id: " << plat.name << std::endl;
+				pid = plat.id;
+				return;
+			}
+   		}
 
-   			plat_name.resize(STRING_BUFSIZE);
-   			vendor_name.resize(STRING_BUFSIZE);
+   		throw(Exception{"No platform could be choosen"});		
 
-	   		ret = clGetPlatformInfo(platforms[i], CL_PLATFORM_NAME, plat_name.size(), plat_name.data(), NULL);
+	};
 
-			CHECK_ERR(ret, clGetPlatformInfo);
+	Platform(cl_platform_id id): pid(id){
+	}
 
-	   		ret = clGetPlatformInfo(platforms[i], CL_PLATFORM_VENDOR, vendor_name.size(), vendor_name.data(), NULL);
+	virtual ~Platform(){};
+};
 
-			CHECK_ERR(ret, clGetPlatformInfo);
 
-			if(plat_name.starts_with(platform_name) || vendor_name.starts_with(platform_name)){
-   				std::cout << "Choosen platform id: " << plat_name << std::endl;
-				pid = platforms[i];
-				return;
-			}
+class Program;
+class Queue;
+class Scheduler;
 
-				
-   		}
+class BuildOptions{
 
-   		throw(Exception{"No platform could be choosen"});		
+	// Collects clBuildProgram options, define() bakes problem constants into kernels
 
-	};
+	std::stringstream ss_;
 
-	virtual ~Platform(){};
+public:
+
+	template<typename T>
+	BuildOptions& define(const char* name, T const& value){
+		ss_ << " -D " << name << "=" << value;
+		return *this;
+	}
+
+	BuildOptions& add(const char* option){
+		ss_ << " " << option;
+		return *this;
+	}
+
+	std::string str() const{
+		return ss_.str();
+	}
+};
+
+struct ProgramRequest{
+	std::string file_path;
+	std::string options;
+};
+
+struct DevicePartition{
+
+	// How Context splits its device with clCreateSubDevices: kind is CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN
+	// with an affinity domain as value, or CL_DEVICE_PARTITION_EQUALLY with compute units per sub-device
+
+	cl_device_partition_property kind;
+	cl_device_partition_property value;
 };
 
+constexpr DevicePartition PARTITION_BY_NUMA{CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, CL_DEVICE_AFFINITY_DOMAIN_NUMA};
 
 class Context: public Platform{
 
 	cl_context ct;
 	std::vector<cl_device_id> devices;
+	bool sub_devices_ = false; // devices are partitions of one device, released with the context
+
+	// built or being built programs by file and options, shared by all threads using the context
+
+	mutable std::map<std::string, std::shared_future<std::unique_ptr<Program>>> programs_;
+	mutable std::mutex programs_mutex_;
+
+	// one queue per device kept for work split between devices, see withDeviceQueues
+
+	mutable std::vector<std::shared_ptr<Queue>> device_queues_;
+	mutable std::mutex device_queues_mutex_;
+
+	// scheduler kept for calls overlapping independent commands, see withScheduler
+
+	mutable std::shared_ptr<Scheduler> scheduler_;
+	mutable std::mutex scheduler_mutex_;
+
+	std::unique_ptr<Program> loadProgram(const char* file_path, std::string const& options) const;
+
+	void createContext(){
+
+#ifdef SHOW_OCL_INFO
+
+        printDevicesInfo();
+
+#endif
+
+		cl_int ret;
+
+        cl_context_properties props[] = {CL_CONTEXT_PLATFORM, reinterpret_cast<cl_context_properties>(pid), 0};
+   		ct = clCreateContext( props, devices.size(), devices.data(), NULL, NULL, &ret);
+
+        CHECK_ERR(ret, clCreateContext);
+
+        std::cout << "Context created with " << devices.size() << " devices avaible"<< std::endl;
+	}
 
 public:
 
@@ -120,90 +624,96 @@ public:
 
 		std::cout << "Avaible devices in the current context:" << std::endl;
 		
-		for(int j = 0; j < 1; j++){
+		for(auto dev: devices){
+			DeviceInfo const& info = deviceInfo(dev);
+
 			std::cout << std::endl;
-	  		char buf[STRING_BUFSIZE];
-			cl_int ret;
-			cl_uint ubuf, i;
-			size_t *psbuf, sbuf;
-			cl_bool cavail, lavail;
-			ret = clGetDeviceInfo(devices[j], CL_DEVICE_NAME, sizeof(buf), buf, NULL);
-			CHECK_ERR(ret, clGetDeviceInfo);
-			printf("Device: %s\n", buf);
-			ret = clGetDeviceInfo(devices[j], CL_DEVICE_VERSION, sizeof(buf), buf, NULL);
-			CHECK_ERR(ret, clGetDeviceInfo);
-			printf("OpenCL version: %s\n", buf);
-
-			ret = clGetDeviceInfo(devices[j], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(ubuf), &ubuf,
-			                        NULL);
-			CHECK_ERR(ret, clGetDeviceInfo);
-			printf("Max units: %u\n", ubuf);
-			ret = clGetDeviceInfo(devices[j], CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS, sizeof(ubuf),
-			                        &ubuf, NULL);
-			CHECK_ERR(ret, clGetDeviceInfo);
-			printf("Max dimensions: %u\n", ubuf);
-
-			psbuf = (size_t*)malloc(sizeof(size_t) * ubuf);
-			ret = clGetDeviceInfo(devices[j], CL_DEVICE_MAX_WORK_ITEM_SIZES,
-			                        sizeof(size_t) * ubuf, psbuf, NULL);
-			CHECK_ERR(ret, clGetDeviceInfo);
+			printf("Device: %s\n", info.name.c_str());
+			printf("OpenCL version: %s\n", deviceString(dev, CL_DEVICE_VERSION).c_str());
+			printf("Max units: %u at %u MHz\n", info.compute_units, info.clock_mhz);
+			printf("Max dimensions: %u\n", (unsigned)info.max_work_item_sizes.size());
 			printf("Max work item sizes: ");
-			for (i = 0; i != ubuf; ++i)
-				printf("%u ", (unsigned)psbuf[i]);
+			for(size_t size: info.max_work_item_sizes)
+				printf("%u ", (unsigned)size);
 			printf("\n");
-			free(psbuf);
-
-			ret = clGetDeviceInfo(devices[j], CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(sbuf),
-			                        &sbuf, NULL);
-			CHECK_ERR(ret, clGetDeviceInfo);
-			printf("Max work group size: %u\n", (unsigned)sbuf);
-
-			ret = clGetDeviceInfo(devices[j], CL_DEVICE_COMPILER_AVAILABLE, sizeof(cavail),
-			                        &cavail, NULL);
-			CHECK_ERR(ret, clGetDeviceInfo);
-			printf("Compiler %savailable\n", cavail ? "" : "not ");
-			ret = clGetDeviceInfo(devices[j], CL_DEVICE_LINKER_AVAILABLE, sizeof(lavail),
-			                        &lavail, NULL);
-			CHECK_ERR(ret, clGetDeviceInfo);
-			printf("Linker %savailable\n", lavail ? "" : "not ");
+			printf("Max work group size: %u\n", (unsigned)info.max_work_group_size);
+			printf("Local memory: %llu KiB, global memory: %llu MiB\n", (unsigned long long)info.local_mem >> 10, (unsigned long long)info.global_mem >> 20);
+			printf("Double precision %savailable\n", info.fp64 ? "" : "not ");
+			printf("Score: %.0f\n", info.score());
 			printf("\n");
-
 		}
+	}
 
+	Context(): Context(bestDevice()){
 
+		// Context on the highest scoring device of all platforms
 	}
-	Context(const char* platform_name = "Intel", cl_device_type dtype = CL_DEVICE_TYPE_ALL, int dev_count = 1): Platform{platform_name}{
+
+	Context(const char* platform_name, cl_device_type dtype = CL_DEVICE_TYPE_ALL, int dev_count = 1): Platform{platform_name}{
 		std::cout << std::endl << "#Creating context..." << std::endl;
 		std::cout << "Looking for avaible devices on choosen platform..." << std::endl;
-		
-		devices.resize(dev_count);
-		
-		cl_uint n_actual_devices;
 
-		cl_int ret = clGetDeviceIDs( pid, dtype, dev_count, 
-        devices.data(), &n_actual_devices);
+		for(auto const& info: capabilities().devices)
+			if(info.platform == pid && (info.type & dtype))
+				devices.push_back(info.id);
 
-        CHECK_ERR(ret, clGetDeviceIDs);
+		if(devices.empty())
+			throw(Exception{"clGetDeviceIDs", CL_DEVICE_NOT_FOUND, __LINE__, __FILE__});
 
-        std::cout << "There are " << n_actual_devices << " devices matching needed device type on this platform" << std::endl;
+        std::cout << "There are " << devices.size() << " devices matching needed device type on this platform" << std::endl;
 
-        if(dev_count > n_actual_devices) dev_count = n_actual_devices;
+        if(static_cast<size_t>(dev_count) < devices.size())
+        	devices.resize(dev_count);
 
-        devices.resize(dev_count);
+        createContext();
+	};
 
-#ifdef SHOW_OCL_INFO
+	Context(DeviceInfo const& device): Platform{device.platform}{
 
-        printDevicesInfo();
+		// Context on one known device, e.g. Context{bestDevice(CL_DEVICE_TYPE_GPU)}
 
-#endif
-        
-        cl_context_properties props[] = {CL_CONTEXT_PLATFORM, reinterpret_cast<cl_context_properties>(pid), 0};
-   		ct = clCreateContext( props, dev_count, devices.data(), NULL, NULL, &ret);
+		std::cout << std::endl << "#Creating context on " << device.name << "..." << std::endl;
 
-        CHECK_ERR(ret, clCreateContext);
+		devices.push_back(device.id);
 
-        std::cout << "Context created with " << devices.size() << " devices avaible"<< std::endl;
-	};
+		createContext();
+	}
+
+	Context(DeviceInfo const& device, DevicePartition partition): Platform{device.platform}{
+
+		// Context over sub-devices of a known device, e.g. one per NUMA node of a multi-socket
+		// CPU: Context{bestDevice(CL_DEVICE_TYPE_CPU), PARTITION_BY_NUMA}. Every partition is
+		// a context device, so per-device queues of Scheduler and Executor become per-partition ones
+
+		std::cout << std::endl << "#Creating partitioned context on " << device.name << "..." << std::endl;
+
+		cl_device_id root = device.id;
+
+		cl_device_partition_property props[] = {partition.kind, partition.value, 0};
+
+		cl_uint n_partitions;
+
+		cl_int ret = clCreateSubDevices(root, props, 0, NULL, &n_partitions);
+		CHECK_ERR(ret, clCreateSubDevices);
+
+		devices.resize(n_partitions);
+
+		ret = clCreateSubDevices(root, props, n_partitions, devices.data(), NULL);
+		CHECK_ERR(ret, clCreateSubDevices);
+
+		sub_devices_ = true;
+
+		std::cout << "Device is split into " << n_partitions << " partitions" << std::endl;
+
+		try{
+			createContext();
+		}
+		catch(...){
+			for(auto dev: devices)
+				clReleaseDevice(dev);
+			throw;
+		}
+	}
 
 
 	cl_context context() const{
@@ -222,12 +732,42 @@ public:
 		return devices.size();
 	}
 
+	bool partitioned() const{
+		return sub_devices_;
+	}
+
+	DeviceInfo const& info(size_t index = 0) const{
+		return deviceInfo(devices[index]);
+	}
 
-	~Context(){
+	size_t baseAddrAlign() const{
 
-		clReleaseContext(ct);
-	
-	};
+		// Strictest CL_DEVICE_MEM_BASE_ADDR_ALIGN of context devices, in bytes
+
+		size_t align = 1;
+
+		for(auto dev: devices)
+			align = std::max(align, deviceInfo(dev).base_addr_align);
+
+		return align;
+	}
+
+
+	Context(Context const& another) = delete;
+
+	Context const& operator=(Context const& another) = delete;
+
+	Program const& getProgram(const char* file_path, std::string const& options = "") const;
+
+	void warmUp(std::vector<ProgramRequest> const& requests) const;
+
+	std::string binaryPath(const char* file_path, std::string const& options = "") const;
+
+	void withDeviceQueues(std::function<void(std::vector<std::shared_ptr<Queue>>&)> const& job) const;
+
+	void withScheduler(std::function<void(Scheduler&)> const& job) const;
+
+	~Context();
 };
 
 
@@ -244,14 +784,58 @@ public:
 class Queue {
 
 	cl_command_queue queue_;
-	std::list<Task*> tasks;
 
-public:
-	Queue(Context const& ct, cl_command_queue_properties properties = 0){
-		cl_int ret;
-		queue_ = clCreateCommandQueue(ct.context(), ct.getDevice(), properties, &ret);
-		CHECK_ERR(ret, clCreateCommandQueue);
-	}
+	// Tasks given by value live in arena chunks which are reused after every execute(),
+	// so a queue in steady state allocates nothing per task
+
+	enum { ARENA_CHUNK = 4096 };
+
+	struct Entry{
+		Task* task;
+		bool in_arena; // otherwise owned pointer from addTask
+	};
+
+	std::vector<Entry> tasks_;
+	std::vector<std::unique_ptr<char[]>> arena_;
+	size_t chunk_ = 0, offset_ = 0;
+
+	void* allocate(size_t size, size_t align){
+		offset_ = (offset_ + align - 1) / align * align;
+
+		if(offset_ + size > ARENA_CHUNK || arena_.empty()){
+			if(!arena_.empty())
+				chunk_++;
+			if(chunk_ == arena_.size())
+				arena_.emplace_back(new char[ARENA_CHUNK]);
+			offset_ = 0;
+		}
+
+		void* ret = arena_[chunk_].get() + offset_;
+		offset_ += size;
+		return ret;
+	}
+
+	void clear(){
+		for(auto& entry: tasks_){
+			if(entry.in_arena)
+				entry.task->~Task();
+			else
+				delete(entry.task);
+		}
+
+		tasks_.clear();
+		chunk_ = offset_ = 0;
+	}
+
+public:
+	Queue(Context const& ct, cl_command_queue_properties properties = 0): Queue(ct, ct.getDevice(), properties){
+	}
+
+	Queue(Context const& ct, cl_device_id device, cl_command_queue_properties properties = 0){
+		cl_int ret;
+		queue_ = clCreateCommandQueue(ct.context(), device, properties, &ret);
+		CHECK_ERR(ret, clCreateCommandQueue);
+	}
 
 	Queue(Queue const& another) = delete;
 
@@ -273,33 +857,118 @@ public:
 #endif
 
 	void execute() {
-		while(!tasks.empty()){
-			Task* task = tasks.back();
-			task->run(queue_);
-			delete(task);
-			tasks.pop_back();
+
+		// runs tasks in the order they were added, tasks left after a failure are dropped
+
+		try{
+			for(auto& entry: tasks_)
+				entry.task->run(queue_);
 		}
+		catch(...){
+			clear();
+			throw;
+		}
+
+		clear();
 	}
 
 	void addTask(Task* task){
-		tasks.push_front(task);
+		tasks_.push_back(Entry{task, false});
+	}
+
+	template<typename T>
+	void add(T&& task){
+		using TaskType = std::decay_t<T>;
+		static_assert(sizeof(TaskType) <= ARENA_CHUNK, "Task doesn't fit arena chunk");
+
+		Task* placed = new(allocate(sizeof(TaskType), alignof(TaskType))) TaskType(std::forward<T>(task));
+		tasks_.push_back(Entry{placed, true});
+	}
+
+	template<typename F>
+	std::future<std::invoke_result_t<F&>> whenDone(F&& f){
+
+		// Executes added tasks and returns at once. When every command enqueued so far
+		// completes, f is called from the event callback and its result (or exception)
+		// resolves the future. f runs on an OpenCL runtime thread and must not call
+		// blocking OpenCL functions, it is meant to hand results over and release buffers
+
+		using Result = std::invoke_result_t<F&>;
+
+		struct Completion{
+			std::decay_t<F> f;
+			std::promise<Result> promise;
+
+			static void CL_CALLBACK callback(cl_event event, cl_int status, void* data){
+				std::unique_ptr<Completion> self{static_cast<Completion*>(data)};
+
+				clReleaseEvent(event);
+
+				try{
+					if(status != CL_COMPLETE)
+						throw(Exception{"Queue::whenDone", status, __LINE__, __FILE__});
+
+					if constexpr(std::is_void_v<Result>){
+						self->f();
+						self->promise.set_value();
+					}
+					else
+						self->promise.set_value(self->f());
+				}
+				catch(...){
+					self->promise.set_exception(std::current_exception());
+				}
+			}
+		};
+
+		execute();
+
+		cl_event event;
+		cl_int ret = clEnqueueMarkerWithWaitList(queue_, 0, NULL, &event);
+		CHECK_ERR(ret, clEnqueueMarkerWithWaitList);
+
+		auto completion = std::make_unique<Completion>(Completion{std::forward<F>(f), {}});
+		std::future<Result> future = completion->promise.get_future();
+
+		ret = clSetEventCallback(event, CL_COMPLETE, &Completion::callback, completion.get());
+
+		if(ret != CL_SUCCESS){
+			clReleaseEvent(event);
+			CHECK_ERR(ret, clSetEventCallback);
+		}
+
+		completion.release(); // deleted by the callback
+
+		clFlush(queue_); // commands must be submitted for the callback to ever come
+
+		return future;
 	}
 
 	cl_command_queue queue() const{
 		return queue_;
 	}
 	virtual ~Queue(){
-		while(!tasks.empty()){
-			delete(tasks.back());
-			tasks.pop_back();			
-		}
+		clear();
 		clFlush(queue_);
-		clFinish(queue_);		
+		waitQueue(queue_);
+		clReleaseCommandQueue(queue_);
 		
 	}
 
 };
 
+inline std::vector<std::unique_ptr<Queue>> deviceQueues(Context const& ct, cl_command_queue_properties properties = 0){
+
+	// One queue per context device, that is per partition of a partitioned context
+
+	std::vector<std::unique_ptr<Queue>> ret;
+
+	for(cl_uint i = 0; i < ct.getNumOfDevices(); i++)
+		ret.push_back(std::make_unique<Queue>(ct, ct.getDevices()[i], properties));
+
+	return ret;
+}
+
 template<typename T>
 class Buffer {
 	
@@ -310,27 +979,65 @@ class Buffer {
 
 	//host part
 
-	std::vector<T>* data_;
-	bool is_extern_data = false;
+	aligned_vector<T> own_data_; // empty when host data is external
+	T* data_;
+	size_t count_;
 
-public:
+	// vector given by pointer and a check that its storage is still data_, count_
 
-	Buffer(Context const& ct, size_t size, cl_mem_flags flags = CL_MEM_READ_WRITE): 
-												flags_(flags), data_(new std::vector<T>(size)){
-		
+	const void* extern_vector_ = nullptr;
+	bool (*extern_matches_)(const void* vector, const T* data, size_t count) = nullptr;
+
+	void create(Context const& ct){
 		cl_int ret;
-		buffer_ = clCreateBuffer(ct.context(), flags, size * sizeof(T), NULL, &ret);
+
+		// With CL_MEM_USE_HOST_PTR the device works on host data in place (zero-copy on
+		// shared memory devices), so data_ has to stay valid for the buffer's lifetime
+
+		void* host_ptr = flags_ & (CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR) ? data_ : NULL;
+		buffer_ = clCreateBuffer(ct.context(), flags_, count_ * sizeof(T), host_ptr, &ret);
 		CHECK_ERR(ret, clCreateBuffer);
-	
+
+		metrics().allocation(count_ * sizeof(T));
+	}
+
+public:
+
+	Buffer(Context const& ct, size_t size, cl_mem_flags flags = CL_MEM_READ_WRITE): 
+												flags_(flags), own_data_(size), data_(own_data_.data()), count_(size){
+		create(ct);
+	}
+
+	template<typename Alloc>
+	Buffer(Context const& ct, std::vector<T, Alloc>* extern_data, cl_mem_flags flags = CL_MEM_READ_WRITE): 
+												flags_(flags), data_(extern_data->data()), count_(extern_data->size()){
+
+		// Device size is fixed here, so the vector must not be resized or reallocated
+		// while the buffer lives, hostData() throws if it was
+
+		extern_vector_ = extern_data;
+		extern_matches_ = [](const void* vector, const T* data, size_t count){
+			auto vec = static_cast<std::vector<T, Alloc> const*>(vector);
+			return vec->data() == data && vec->size() == count;
+		};
+
+		create(ct);
+	}
+
+	Buffer(Context const& ct, T* begin, T* end, cl_mem_flags flags = CL_MEM_READ_WRITE): 
+												flags_(flags), data_(begin), count_(end - begin){
+
+		// Device part of an external host range, e.g. one partition's share of an array
+
+		create(ct);
 	}
 
-	Buffer(Context const& ct, std::vector<T>* extern_data, cl_mem_flags flags = CL_MEM_READ_WRITE): 
-												flags_(flags), data_(extern_data), is_extern_data(true){
+	Buffer(Context const& ct, aligned_vector<T>&& data, cl_mem_flags flags = CL_MEM_READ_WRITE): 
+												flags_(flags), own_data_(std::move(data)), data_(own_data_.data()), count_(own_data_.size()){
 		
-		cl_int ret;
-		buffer_ = clCreateBuffer(ct.context(), flags, data_->size() * sizeof(T), NULL, &ret);
-		CHECK_ERR(ret, clCreateBuffer);
-	
+		// Takes host storage over without copying
+
+		create(ct);
 	}
 
 	Buffer(Buffer const& another) = delete;
@@ -355,7 +1062,7 @@ public:
 #endif
 
 	size_t size() const{
-		return data_->size() * sizeof(T);
+		return count_ * sizeof(T);
 	}
 
 	cl_mem& buffer() {
@@ -363,41 +1070,194 @@ public:
 	};
 
 	T* hostData() {
-		return data_->data();
+		if(extern_vector_ && !extern_matches_(extern_vector_, data_, count_))
+			throw(Exception{"Host vector of buffer was resized or reallocated"});
+
+		return data_;
 	}
 
-	auto begin(){
-		return data_->begin();
+	T* begin(){
+		return data_;
 	}
 
-	auto end(){
-		return data_->end();
+	T* end(){
+		return data_ + count_;
 	}
 
 	T& operator[](size_t index){
-		if(index > data_->size()){
+		if(index >= count_){
 			std::stringstream ss;
-			ss << "Index " << index << " is out of buffer range(" << data_->size() << ")"; 
+			ss << "Index " << index << " is out of buffer range(" << count_ << ")"; 
 			throw(std::out_of_range{ss.str()});
 		}
 
-		return (*data_)[index];
+		return data_[index];
+	}
+
+	aligned_vector<T> releaseHostData(){
+
+		// Moves owned host storage out, buffer keeps only device part
+
+		if(own_data_.empty() && count_ != 0)
+			throw(Exception{"Buffer doesn't own its host data"});
+
+		data_ = nullptr;
+		count_ = 0;
+
+		return std::move(own_data_);
 	}
 
 	virtual ~Buffer(){
 		clReleaseMemObject(buffer_);
-
-		if(!is_extern_data)
-			delete data_;
 	};
 };
 
-enum { MAX_SOURCEFILE_LENGTH = 10000};
+struct EmbeddedSource{
+
+	// OpenCL source compiled into the binary, hash is FNV-1a of the text
+
+	const char* name;
+	const char* source;
+	size_t length;
+	uint64_t hash;
+
+	static constexpr uint64_t fnv1a(const char* text, size_t length, uint64_t hash = 14695981039346656037ull){
+		for(size_t i = 0; i < length; i++)
+			hash = (hash ^ static_cast<unsigned char>(text[i])) * 1099511628211ull;
+		return hash;
+	}
+
+	template<size_t N>
+	constexpr EmbeddedSource(const char* name_, const char (&source_)[N]): name(name_), source(source_), length(N - 1), hash(fnv1a(source_, N - 1)){
+	}
+};
+
+}
+
+// kernels.hpp is generated by makefile from *.cl, without it sources are read from disk
+
+#if __has_include("kernels.hpp")
+#include "kernels.hpp"
+#define MYFCL_HAS_EMBEDDED_SOURCES
+#endif
+
+namespace myfcl{
+
+inline EmbeddedSource const* findEmbeddedSource([[maybe_unused]] const char* name){ // name is unused without kernels.hpp
+#ifdef MYFCL_HAS_EMBEDDED_SOURCES
+	for(auto const& src: embedded_sources)
+		if(std::string_view{src.name} == name)
+			return &src;
+#endif
+	return nullptr;
+}
+
+inline bool readFile(const char* path, std::string& text){
+	std::ifstream file(path, std::ios::binary);
+	if(!file.good())
+		return false;
+
+	text.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+	return true;
+}
+
+#ifndef MYFCL_BINARY_DIR
+#define MYFCL_BINARY_DIR "clbin" // where makefile puts ahead-of-time compiled programs
+#endif
+
+inline uint64_t sourceHash(const char* file_path){
+
+	// Hash of the source a program is built from: embedded one or the file, 0 if there is none
+
+	std::string source;
+	EmbeddedSource const* src = findEmbeddedSource(file_path);
+
+	return src ? src->hash : readFile(file_path, source) ? EmbeddedSource::fnv1a(source.data(), source.size()) : 0;
+}
+
+inline bool readSpirv(const char* file_path, std::string& il){
+
+	// SPIR-V has a single name for all source versions, so makefile keeps the source it was
+	// built from next to it; stale SPIR-V, with that source hashing differently, is not read
+
+	std::string path = std::string{MYFCL_BINARY_DIR "/"} + file_path + ".spv";
+	std::string built_from;
+
+	uint64_t hash = sourceHash(file_path);
+
+	if(hash == 0 || !readFile((path + ".src").c_str(), built_from) || EmbeddedSource::fnv1a(built_from.data(), built_from.size()) != hash)
+		return false;
+
+	return readFile(path.c_str(), il);
+}
+
+enum ProgramFormat{ PF_SOURCE, PF_BINARY, PF_IL };
 
 class Program{
 
 	cl_program program_;
 
+	void create(Context const& ct, const char* name, const char* data, size_t length, ProgramFormat format, const char* options){
+		cl_int ret;
+
+		switch(format){
+		case PF_SOURCE:
+			std::cout << "Building programm " << name << (options && *options ? options : "") << "..." << std::endl;
+			program_ = clCreateProgramWithSource(ct.context(), 1, &data, &length, &ret);
+			CHECK_ERR(ret, clCreateProgramWithSource);
+			break;
+
+		case PF_BINARY:{
+			std::cout << "Loading programm " << name << " from device binary..." << std::endl;
+
+			// the same binary is given to every device, so it's meant for single device contexts
+
+			std::vector<const unsigned char*> binaries(ct.getNumOfDevices(), reinterpret_cast<const unsigned char*>(data));
+			std::vector<size_t> lengths(ct.getNumOfDevices(), length);
+			std::vector<cl_int> status(ct.getNumOfDevices());
+
+			program_ = clCreateProgramWithBinary(ct.context(), ct.getNumOfDevices(), ct.getDevices(), lengths.data(), binaries.data(), status.data(), &ret);
+			CHECK_ERR(ret, clCreateProgramWithBinary);
+			break;
+		}
+
+		case PF_IL:
+#ifdef CL_VERSION_2_1
+			std::cout << "Loading programm " << name << " from SPIR-V..." << std::endl;
+			program_ = clCreateProgramWithIL(ct.context(), data, length, &ret);
+			CHECK_ERR(ret, clCreateProgramWithIL);
+			break;
+#else
+			throw(Exception{"Programs from SPIR-V need OpenCL 2.1 headers"});
+#endif
+		}
+
+		auto start = std::chrono::steady_clock::now();
+
+		ret = clBuildProgram(program_, ct.getNumOfDevices(), ct.getDevices(), options, NULL, NULL);
+
+		metrics().build(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+		if(ret != CL_SUCCESS){
+			for(int i = 0; i < ct.getNumOfDevices(); i++){
+				size_t log_size = 0;
+				clGetProgramBuildInfo(program_, ct.getDevices()[i], CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+
+				std::string log;
+				log.resize(log_size);
+
+				clGetProgramBuildInfo(program_, ct.getDevices()[i], CL_PROGRAM_BUILD_LOG, log.size(), log.data(), NULL);
+
+				std::cout << "Programm build failed with following log:" << std::endl << log << std::endl;
+			}
+			clReleaseProgram(program_);
+		}
+		
+		CHECK_ERR(ret, clBuildProgram);
+
+		std::cout << "Programm has been built successfuly" << std::endl;
+	}
+
 public:
 
 	Program(Program const& another) = delete;
@@ -420,44 +1280,50 @@ public:
 
 #endif
 
-	Program(Context const& ct, const char* file_path){
-		std::cout << "Building programm " << file_path << "..." << std::endl;
-		std::fstream prog_file(file_path);
-		if(!prog_file.good()){
+	Program(Context const& ct, const char* file_path, const char* options = NULL){
+		std::string prog_source_code;
+
+		if(!readFile(file_path, prog_source_code)){
 			std::stringstream ss;
 			ss << "Program file " << file_path << " cannot be opened"; 
 			throw(Exception(ss.str().c_str()));
 		}
 
-		std::string prog_source_code;
-		prog_source_code.resize(MAX_SOURCEFILE_LENGTH + 1);
-		prog_file.read(prog_source_code.data(), MAX_SOURCEFILE_LENGTH);
+		create(ct, file_path, prog_source_code.data(), prog_source_code.size(), PF_SOURCE, options);
+	}
 
-		prog_source_code.data()[MAX_SOURCEFILE_LENGTH] = '\0';
+	Program(Context const& ct, EmbeddedSource const& src, const char* options = NULL){
+		create(ct, src.name, src.source, src.length, PF_SOURCE, options);
+	}
 
-		cl_int ret;
-		
-		const char* code = prog_source_code.data();
-		
-		program_ = clCreateProgramWithSource(ct.context(), 1, &code, NULL, &ret);
-		CHECK_ERR(ret, clCreateProgramWithSource);
+	Program(Context const& ct, const char* name, std::string const& data, ProgramFormat format, const char* options = NULL){
+		create(ct, name, data.data(), data.size(), format, options);
+	}
 
-		ret = clBuildProgram(program_, ct.getNumOfDevices(), ct.getDevices(), NULL, NULL, NULL);
+	std::string binary() const{
 
-		if(ret != CL_SUCCESS){
-			for(int i = 0; i < ct.getNumOfDevices(); i++){
-				std::string log;
-				log.resize(10000);
+		// Device binary of the first device, input for PF_BINARY
 
-				clGetProgramBuildInfo(program_, ct.getDevices()[i], CL_PROGRAM_BUILD_LOG, 10000, log.data(), NULL);
+		cl_uint n_devices;
+		cl_int ret = clGetProgramInfo(program_, CL_PROGRAM_NUM_DEVICES, sizeof(n_devices), &n_devices, NULL);
+		CHECK_ERR(ret, clGetProgramInfo);
 
-				std::cout << "Programm build failed with following log:" << std::endl << log << std::endl;
-			}
+		std::vector<size_t> sizes(n_devices);
+		ret = clGetProgramInfo(program_, CL_PROGRAM_BINARY_SIZES, sizes.size() * sizeof(size_t), sizes.data(), NULL);
+		CHECK_ERR(ret, clGetProgramInfo);
+
+		std::vector<std::string> binaries(n_devices);
+		std::vector<unsigned char*> ptrs(n_devices);
+
+		for(cl_uint i = 0; i < n_devices; i++){
+			binaries[i].resize(sizes[i]);
+			ptrs[i] = reinterpret_cast<unsigned char*>(binaries[i].data());
 		}
-		
-		CHECK_ERR(ret, clBuildProgram);
 
-		std::cout << "Programm has been built successfuly" << std::endl;
+		ret = clGetProgramInfo(program_, CL_PROGRAM_BINARIES, ptrs.size() * sizeof(unsigned char*), ptrs.data(), NULL);
+		CHECK_ERR(ret, clGetProgramInfo);
+
+		return binaries[0];
 	}
 
 	cl_program program() const{
@@ -469,6 +1335,155 @@ public:
 	}
 };
 
+inline std::string Context::binaryPath(const char* file_path, std::string const& options) const{
+
+	// Binary file name carries hash of source, options and device, so stale binaries are never picked up
+
+	uint64_t hash = sourceHash(file_path);
+
+	std::string const& dev_name = info().name;
+
+	hash = EmbeddedSource::fnv1a(options.data(), options.size(), hash);
+	hash = EmbeddedSource::fnv1a(dev_name.data(), dev_name.size(), hash);
+
+	std::stringstream ss;
+	ss << MYFCL_BINARY_DIR << "/" << file_path << "-" << std::hex << hash << ".bin";
+	return ss.str();
+}
+
+inline std::unique_ptr<Program> Context::loadProgram(const char* file_path, std::string const& options) const{
+
+	// Ahead-of-time compiled forms come first: SPIR-V for the generic variant (-D can't change it),
+	// then device binary; source is the fallback when they are missing or rejected by the driver
+
+	std::string blob;
+
+	if(options.empty() && readSpirv(file_path, blob)){
+		try{
+			return std::make_unique<Program>(*this, file_path, blob, PF_IL);
+		}
+		catch(Exception const&){
+			std::cout << "SPIR-V of " << file_path << " is not accepted, falling back" << std::endl;
+		}
+	}
+
+	if(devices.size() == 1 && readFile(binaryPath(file_path, options).c_str(), blob)){
+		try{
+			return std::make_unique<Program>(*this, file_path, blob, PF_BINARY, options.c_str());
+		}
+		catch(Exception const&){
+			std::cout << "Device binary of " << file_path << " is not accepted, falling back" << std::endl;
+		}
+	}
+
+	EmbeddedSource const* src = findEmbeddedSource(file_path);
+
+	return src ? std::make_unique<Program>(*this, *src, options.c_str()) : std::make_unique<Program>(*this, file_path, options.c_str());
+}
+
+inline Program const& Context::getProgram(const char* file_path, std::string const& options) const{
+
+	// Builds program on first request only, every set of options is a separate variant
+	// Embedded source is preferred, file is read only if the binary has no such source
+	// Safe to call from many threads: the cache is locked only to look the build up,
+	// threads requesting a program being built wait for that build without holding the lock
+
+	std::string key = std::string{file_path} + '|' + options;
+
+	std::shared_future<std::unique_ptr<Program>> build;
+
+	{
+		std::lock_guard<std::mutex> lock{programs_mutex_};
+
+		auto found = programs_.find(key);
+
+		if(found == programs_.end()){
+			std::string path{file_path};
+			found = programs_.emplace(key, std::async(std::launch::deferred, [this, path, options]{
+				return loadProgram(path.c_str(), options);
+			}).share()).first;
+		}
+
+		build = found->second;
+	}
+
+	try{
+		return *build.get(); // waits for this build only, deferred ones run here
+	}
+	catch(...){
+		// failed build is retried on the next request, unless another thread already started it
+
+		std::lock_guard<std::mutex> lock{programs_mutex_};
+
+		auto found = programs_.find(key);
+
+		if(found != programs_.end() && found->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready){
+			try{
+				found->second.get();
+			}
+			catch(...){
+				programs_.erase(found);
+			}
+		}
+
+		throw;
+	}
+}
+
+inline void Context::warmUp(std::vector<ProgramRequest> const& requests) const{
+
+	// Starts builds of all requested programs at once, each on its own thread,
+	// so startup takes as long as the longest build instead of their sum
+
+	std::lock_guard<std::mutex> lock{programs_mutex_};
+
+	for(auto const& req: requests){
+		std::string key = req.file_path + '|' + req.options;
+
+		if(programs_.count(key))
+			continue;
+
+		programs_.emplace(key, std::async(std::launch::async, [this, req]{
+			return loadProgram(req.file_path.c_str(), req.options);
+		}).share());
+	}
+}
+
+inline void Context::withDeviceQueues(std::function<void(std::vector<std::shared_ptr<Queue>>&)> const& job) const{
+
+	// Runs job on queues of all context devices, created on first use and reused by later calls,
+	// jobs are serialized since queues aren't thread-safe
+
+	std::lock_guard<std::mutex> lock{device_queues_mutex_};
+
+	if(device_queues_.empty())
+		for(auto dev: devices)
+			device_queues_.push_back(std::make_shared<Queue>(*this, dev));
+
+	try{
+		job(device_queues_);
+	}
+	catch(...){
+		device_queues_.clear(); // drops tasks the job left unexecuted and waits for enqueued ones
+		throw;
+	}
+}
+
+inline Context::~Context(){
+
+	scheduler_.reset(); // both released before the context, after their commands complete
+
+	device_queues_.clear();
+
+	programs_.clear(); // waits for warm-up builds still running
+
+	clReleaseContext(ct);
+
+	if(sub_devices_)
+		for(auto dev: devices)
+			clReleaseDevice(dev);
+}
+
 
 class NDRange // Copied from CL/cl2.hpp
 {
@@ -550,6 +1565,7 @@ public:
 class Kernel{
 
 	cl_kernel kernel_;
+	std::atomic<uint64_t>* launches_; // of this kernel name, see Metrics
 
 public:
 
@@ -579,7 +1595,7 @@ public:
 		CHECK_ERR(ret, clSetKernelArg);
 	}
 
-	Kernel(Program const& prog, const char* name){
+	Kernel(Program const& prog, const char* name): launches_(metrics().kernelCounter(name)){
 		cl_int ret;
 		kernel_ = clCreateKernel(prog.program(), name, &ret);
 		CHECK_ERR(ret, clCreateKernel);
@@ -589,6 +1605,17 @@ public:
 	cl_kernel kernel() const{
 		return kernel_;
 	}
+
+	size_t workGroupSize(cl_device_id device) const{ // largest work-group this kernel can run with on device, may be below device limit
+		size_t size;
+		cl_int ret = clGetKernelWorkGroupInfo(kernel_, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size), &size, NULL);
+		CHECK_ERR(ret, clGetKernelWorkGroupInfo);
+		return size;
+	}
+
+	void launched() const{ // counts an enqueue of the kernel
+		metrics().launch(launches_);
+	}
 	~Kernel(){
 		clReleaseKernel(kernel_);
 	}
@@ -597,32 +1624,110 @@ public:
 template<typename T>
 class Read: public Task{
 	Buffer<T>& buf_;
+	size_t count_;
+	cl_bool blocking_ = CL_TRUE;
+protected:
+	Read(Buffer<T>& buf, size_t count, cl_bool blocking): buf_(buf), count_(count), blocking_(blocking) {
+	};
 public:
-	Read(Buffer<T>& buf): buf_(buf) {
+	Read(Buffer<T>& buf): buf_(buf), count_(buf.size() / sizeof(T)) {
+	};
+
+	Read(Buffer<T>& buf, size_t count): buf_(buf), count_(count) { // reads only first count elements
 	};
 
 	void run(cl_command_queue queue) override{
-		cl_int ret = clEnqueueReadBuffer(queue, buf_.buffer(), CL_TRUE, 0, buf_.size(), buf_.hostData(), 0, NULL, NULL);
+		metrics().toHost(count_ * sizeof(T));
+
+		std::optional<HostWait> wait;
+
+		if(blocking_)
+			wait.emplace();
+
+		cl_int ret = clEnqueueReadBuffer(queue, buf_.buffer(), blocking_, 0, count_ * sizeof(T), buf_.hostData(), 0, NULL, NULL);
 		CHECK_ERR(ret, clEnqueueReadBuffer);
 	}
 
 	~Read(){};
 };
 
+template<typename T>
+class ReadAsync: public Read<T>{ // returns at once, host data is valid when the queue gets past it
+public:
+	ReadAsync(Buffer<T>& buf): Read<T>(buf, buf.size() / sizeof(T), CL_FALSE) {
+	};
+};
+
 template<typename T>
 class Write: public Task{
 	Buffer<T>& buf_;
+	size_t count_;
+	cl_bool blocking_ = CL_TRUE;
+protected:
+	Write(Buffer<T>& buf, size_t count, cl_bool blocking): buf_(buf), count_(count), blocking_(blocking) {
+	};
 public:
-	Write(Buffer<T>& buf): buf_(buf) {
+	Write(Buffer<T>& buf): buf_(buf), count_(buf.size() / sizeof(T)) {
+	};
+
+	Write(Buffer<T>& buf, size_t count): buf_(buf), count_(count) { // writes only first count elements
 	};
 
 	void run(cl_command_queue queue) override{
-		cl_int ret = clEnqueueWriteBuffer(queue, buf_.buffer(), CL_TRUE, 0, buf_.size(), buf_.hostData(), 0, NULL, NULL);
+		metrics().toDevice(count_ * sizeof(T));
+
+		std::optional<HostWait> wait;
+
+		if(blocking_)
+			wait.emplace();
+
+		cl_int ret = clEnqueueWriteBuffer(queue, buf_.buffer(), blocking_, 0, count_ * sizeof(T), buf_.hostData(), 0, NULL, NULL);
 		CHECK_ERR(ret, clEnqueueWriteBuffer);
 	}
 	~Write(){};
 };
 
+template<typename T>
+class WriteAsync: public Write<T>{ // returns at once, host data must stay untouched until the queue gets past it
+public:
+	WriteAsync(Buffer<T>& buf): Write<T>(buf, buf.size() / sizeof(T), CL_FALSE) {
+	};
+};
+
+template<typename T>
+class Copy: public Task{ // device to device, host data of both buffers is left as is
+	Buffer<T>& src_;
+	Buffer<T>& dst_;
+public:
+	Copy(Buffer<T>& src, Buffer<T>& dst): src_(src), dst_(dst) {
+	};
+
+	void run(cl_command_queue queue) override{
+		cl_int ret = clEnqueueCopyBuffer(queue, src_.buffer(), dst_.buffer(), 0, 0, std::min(src_.size(), dst_.size()), 0, NULL, NULL);
+		CHECK_ERR(ret, clEnqueueCopyBuffer);
+
+		metrics().onDevice(std::min(src_.size(), dst_.size()));
+	}
+};
+
+template<typename T>
+class Fill: public Task{
+
+	// Sets every element on device. Done on a partition's queue of a CPU device it is also
+	// the first touch of buffer pages, which places them on that partition's memory node
+
+	Buffer<T>& buf_;
+	T value_;
+public:
+	Fill(Buffer<T>& buf, T value = T{}): buf_(buf), value_(value) {
+	};
+
+	void run(cl_command_queue queue) override{
+		cl_int ret = clEnqueueFillBuffer(queue, buf_.buffer(), &value_, sizeof(T), 0, buf_.size(), 0, NULL, NULL);
+		CHECK_ERR(ret, clEnqueueFillBuffer);
+	}
+};
+
 
 class Execute: public Task{
 	
@@ -634,8 +1739,11 @@ public:
 	};
 
 	void run(cl_command_queue queue) override{
-		cl_int ret = clEnqueueNDRangeKernel(queue, kernel_.kernel(), global_.dimensions(), NULL, global_.get(), local_.get(), 0, NULL, NULL);
+		// empty local range lets implementation choose work-group size
+		cl_int ret = clEnqueueNDRangeKernel(queue, kernel_.kernel(), global_.dimensions(), NULL, global_.get(), local_.dimensions() ? local_.get() : NULL, 0, NULL, NULL);
 		CHECK_ERR(ret, clEnqueueNDRangeKernel);
+
+		kernel_.launched();
 	}
 
 	~Execute(){};
@@ -643,5 +1751,487 @@ public:
 };
 
 
+template<typename T>
+class SetArgument: public Task{
+
+	// Passes value found at param when the task runs, not when it's created
+
+	Kernel const& kernel_;
+	cl_uint index_;
+	T* param_;
+
+public:
+	SetArgument(Kernel const& kernel, cl_uint index, T* param): kernel_(kernel), index_(index), param_(param) {
+	};
+
+	void run(cl_command_queue) override{
+		kernel_.addArgument(index_, param_);
+	}
+
+	~SetArgument(){};
+};
+
+class CommandList{
+
+	// Commands recorded once and replayed many times, replay allocates nothing
+	// Kernel arguments bound to parameters are read at replay, so one list serves every iteration
+
+	std::vector<std::unique_ptr<Task>> commands_;
+
+public:
+
+	template<typename T>
+	void record(T&& task){
+		commands_.push_back(std::make_unique<std::decay_t<T>>(std::forward<T>(task)));
+	}
+
+	template<typename T>
+	void bind(Kernel const& kernel, cl_uint index, T* param){
+		record(SetArgument<T>{kernel, index, param});
+	}
+
+	void replay(Queue& queue) const{
+		queue.execute(); // tasks added before the replay go first
+
+		for(auto const& command: commands_)
+			command->run(queue.queue());
+	}
+
+	size_t size() const{
+		return commands_.size();
+	}
+};
+
+class Scheduler{
+
+	// Spreads commands over a pool of queues on every context device, so independent
+	// transfers and launches overlap. Dependencies come from buffer read/write sets:
+	// a command waits for the last writer of what it reads and writes, and for readers
+	// of what it overwrites. Everything is non-blocking, host data is valid after finish().
+	// Devices supporting out-of-order execution get one such queue, others a few in-order ones.
+
+	struct BufferState{
+		cl_event writer = NULL;
+		std::vector<cl_event> readers;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues_;
+	std::vector<char> unflushed_; // queue got commands since its last flush
+	size_t next_ = 0;
+
+	std::map<cl_mem, BufferState> buffers_;
+
+	std::vector<cl_event> wait_list_; // reused between commands
+
+	cl_command_queue nextQueue(){
+
+		// A queue may wait for events of another one only after that one is flushed,
+		// so queues with unsubmitted commands are flushed before a command with dependencies
+
+		size_t index = next_;
+		next_ = (next_ + 1) % queues_.size();
+
+		if(!wait_list_.empty())
+			for(size_t i = 0; i < queues_.size(); i++)
+				if(i != index && unflushed_[i]){
+					clFlush(queues_[i]->queue());
+					unflushed_[i] = false;
+				}
+
+		unflushed_[index] = true;
+		return queues_[index]->queue();
+	}
+
+	cl_event const* dependencies(std::initializer_list<cl_mem> reads, std::initializer_list<cl_mem> writes){
+		wait_list_.clear();
+
+		for(cl_mem mem: reads){
+			auto found = buffers_.find(mem);
+			if(found != buffers_.end() && found->second.writer)
+				wait_list_.push_back(found->second.writer);
+		}
+
+		for(cl_mem mem: writes){
+			auto found = buffers_.find(mem);
+			if(found == buffers_.end())
+				continue;
+			if(found->second.writer)
+				wait_list_.push_back(found->second.writer);
+			wait_list_.insert(wait_list_.end(), found->second.readers.begin(), found->second.readers.end());
+		}
+
+		return wait_list_.empty() ? NULL : wait_list_.data();
+	}
+
+	void track(cl_event event, std::initializer_list<cl_mem> reads, std::initializer_list<cl_mem> writes){
+		for(cl_mem mem: reads){
+			clRetainEvent(event);
+			buffers_[mem].readers.push_back(event);
+		}
+
+		for(cl_mem mem: writes){
+			BufferState& state = buffers_[mem];
+			release(state);
+			clRetainEvent(event);
+			state.writer = event;
+		}
+
+		clReleaseEvent(event);
+	}
+
+	static void release(BufferState& state){
+		if(state.writer)
+			clReleaseEvent(state.writer);
+		for(cl_event ev: state.readers)
+			clReleaseEvent(ev);
+
+		state.writer = NULL;
+		state.readers.clear();
+	}
+
+public:
+
+	Scheduler(Context const& ct, size_t queues_per_device = 2){
+		for(cl_uint i = 0; i < ct.getNumOfDevices(); i++){
+			cl_device_id device = ct.getDevices()[i];
+
+			if(deviceInfo(device).queue_properties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE)
+				queues_.push_back(std::make_unique<Queue>(ct, device, CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE));
+			else
+				for(size_t j = 0; j < queues_per_device; j++)
+					queues_.push_back(std::make_unique<Queue>(ct, device));
+		}
+
+		unflushed_.resize(queues_.size(), false);
+	}
+
+	Scheduler(Scheduler const& another) = delete;
+
+	Scheduler const& operator=(Scheduler const& another) = delete;
+
+	template<typename T>
+	void write(Buffer<T>& buf){
+		cl_mem mem = buf.buffer();
+		cl_event event;
+
+		cl_event const* deps = dependencies({}, {mem});
+		cl_int ret = clEnqueueWriteBuffer(nextQueue(), mem, CL_FALSE, 0, buf.size(), buf.hostData(), wait_list_.size(), deps, &event);
+		CHECK_ERR(ret, clEnqueueWriteBuffer);
+
+		metrics().toDevice(buf.size());
+
+		track(event, {}, {mem});
+	}
+
+	template<typename T>
+	void read(Buffer<T>& buf){
+		cl_mem mem = buf.buffer();
+		cl_event event;
+
+		cl_event const* deps = dependencies({mem}, {});
+		cl_int ret = clEnqueueReadBuffer(nextQueue(), mem, CL_FALSE, 0, buf.size(), buf.hostData(), wait_list_.size(), deps, &event);
+		CHECK_ERR(ret, clEnqueueReadBuffer);
+
+		metrics().toHost(buf.size());
+
+		track(event, {mem}, {});
+	}
+
+	void launch(Kernel const& kernel, NDRange local, NDRange global, std::initializer_list<cl_mem> reads, std::initializer_list<cl_mem> writes){
+
+		// kernel arguments are captured at this call, kernel may be set up anew right after it
+
+		cl_event event;
+
+		cl_event const* deps = dependencies(reads, writes);
+		cl_int ret = clEnqueueNDRangeKernel(nextQueue(), kernel.kernel(), global.dimensions(), NULL, global.get(), local.dimensions() ? local.get() : NULL,
+											wait_list_.size(), deps, &event);
+		CHECK_ERR(ret, clEnqueueNDRangeKernel);
+
+		kernel.launched();
+
+		track(event, reads, writes);
+	}
+
+	size_t queues() const{
+		return queues_.size();
+	}
+
+	void finish(){
+		for(auto& queue: queues_){
+			cl_int ret = waitQueue(queue->queue());
+			CHECK_ERR(ret, clFinish);
+		}
+
+		std::fill(unflushed_.begin(), unflushed_.end(), false);
+
+		for(auto& buf: buffers_)
+			release(buf.second);
+
+		buffers_.clear();
+	}
+
+	~Scheduler(){
+		for(auto& queue: queues_)
+			waitQueue(queue->queue());
+
+		for(auto& buf: buffers_)
+			release(buf.second);
+	}
+};
+
+inline void Context::withScheduler(std::function<void(Scheduler&)> const& job) const{
+
+	// Runs job on the context scheduler, created on first use and reused by later calls,
+	// and finishes everything it enqueued, so its buffers and host data may go right after.
+	// Jobs are serialized since the scheduler isn't thread-safe
+
+	std::lock_guard<std::mutex> lock{scheduler_mutex_};
+
+	if(!scheduler_)
+		scheduler_ = std::make_shared<Scheduler>(*this);
+
+	try{
+		job(*scheduler_);
+		scheduler_->finish();
+	}
+	catch(...){
+		scheduler_.reset(); // waits for enqueued commands and forgets their buffers
+		throw;
+	}
+}
+
+class Executor{
+
+	// Pool of host threads running jobs against one shared context. Every worker owns
+	// a command queue (workers are spread over context devices) and a deque of jobs:
+	// it takes its newest job first and, when out of work, steals the oldest job of
+	// another worker. A job gets the worker queue and its future is ready only after
+	// everything the job enqueued has finished, so buffers and host data captured by
+	// the job may be released as soon as the future is.
+
+	using Job = std::function<void(Queue&)>;
+
+	struct Worker{
+		Executor* owner;
+		std::unique_ptr<Queue> queue;
+		std::deque<Job> jobs;
+		std::mutex mutex;
+		std::thread thread;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers_;
+
+	std::mutex idle_mutex_;
+	std::condition_variable idle_;
+	size_t pending_ = 0; // jobs in all deques not yet claimed by a worker
+	bool stop_ = false;
+
+	std::atomic<size_t> next_{0};
+
+	static Worker*& current(){
+		static thread_local Worker* worker = nullptr;
+		return worker;
+	}
+
+	void push(Job job){
+		Worker* self = current();
+		Worker& target = self && self->owner == this ? *self : *workers_[next_++ % workers_.size()];
+
+		{
+			std::lock_guard<std::mutex> lock{target.mutex};
+			target.jobs.push_back(std::move(job));
+		}
+
+		{
+			std::lock_guard<std::mutex> lock{idle_mutex_};
+			pending_++;
+		}
+
+		idle_.notify_one();
+	}
+
+	Job take(size_t index){
+
+		// the caller has claimed a job, so some deque holds one for it
+
+		for(;;){
+			{
+				Worker& own = *workers_[index];
+				std::lock_guard<std::mutex> lock{own.mutex};
+				if(!own.jobs.empty()){
+					Job job = std::move(own.jobs.back());
+					own.jobs.pop_back();
+					return job;
+				}
+			}
+
+			for(size_t i = 1; i < workers_.size(); i++){
+				Worker& victim = *workers_[(index + i) % workers_.size()];
+				std::lock_guard<std::mutex> lock{victim.mutex};
+				if(!victim.jobs.empty()){
+					Job job = std::move(victim.jobs.front());
+					victim.jobs.pop_front();
+					return job;
+				}
+			}
+
+			std::this_thread::yield();
+		}
+	}
+
+	void work(size_t index){
+		current() = workers_[index].get();
+
+		for(;;){
+			{
+				std::unique_lock<std::mutex> lock{idle_mutex_};
+				idle_.wait(lock, [this]{ return pending_ != 0 || stop_; });
+
+				if(pending_ == 0)
+					return; // stopped and drained
+
+				pending_--;
+			}
+
+			take(index)(*workers_[index]->queue);
+		}
+	}
+
+public:
+
+	Executor(Context const& ct, size_t workers = std::max(1u, std::thread::hardware_concurrency())){
+		for(size_t i = 0; i < std::max<size_t>(workers, 1); i++){
+			workers_.push_back(std::make_unique<Worker>());
+			workers_.back()->owner = this;
+			workers_.back()->queue = std::make_unique<Queue>(ct, ct.getDevices()[i % ct.getNumOfDevices()]);
+		}
+
+		for(size_t i = 0; i < workers_.size(); i++)
+			workers_[i]->thread = std::thread{&Executor::work, this, i};
+	}
+
+	Executor(Executor const& another) = delete;
+
+	Executor const& operator=(Executor const& another) = delete;
+
+	template<typename F>
+	std::future<std::invoke_result_t<F&, Queue&>> submit(F&& job){
+
+		// job is called as job(queue), its result or exception goes to the future
+
+		using Result = std::invoke_result_t<F&, Queue&>;
+
+		auto task = std::make_shared<std::packaged_task<Result(Queue&)>>([job = std::forward<F>(job)](Queue& queue) mutable -> Result{
+			struct Finish{
+				Queue& queue;
+				~Finish(){ waitQueue(queue.queue()); }
+			} finish{queue};
+
+			return job(queue);
+		});
+
+		std::future<Result> ret = task->get_future();
+
+		push([task](Queue& queue){ (*task)(queue); });
+
+		return ret;
+	}
+
+	size_t size() const{
+		return workers_.size();
+	}
+
+	~Executor(){
+
+		// jobs submitted before destruction are run to the end
+
+		{
+			std::lock_guard<std::mutex> lock{idle_mutex_};
+			stop_ = true;
+		}
+
+		idle_.notify_all();
+
+		for(auto& worker: workers_)
+			worker->thread.join();
+	}
+};
+
+template<typename T>
+struct KernelArg{ // scalar argument, passed by value
+
+	using param_type = T const&;
+	using value_type = T;
+
+	static T value(T const& arg){
+		return arg;
+	}
+};
+
+template<typename T>
+struct KernelArg<Buffer<T>>{ // buffer argument, passed as its cl_mem
+
+	using param_type = Buffer<T>&;
+	using value_type = cl_mem;
+
+	static cl_mem value(Buffer<T>& buf){
+		return buf.buffer();
+	}
+};
+
+template<typename... Args>
+class TypedKernel{
+
+	// Kernel with signature declared as template arguments: launch arguments are checked
+	// at compile time, only changed ones are passed to clSetKernelArg, launch allocates nothing
+
+	Kernel kernel_;
+
+	std::tuple<typename KernelArg<Args>::value_type...> values_;
+	std::array<bool, sizeof...(Args)> is_set_{};
+
+	template<size_t I, typename V>
+	void setArgument(V const& value){
+		V& cached = std::get<I>(values_);
+
+		// bitwise comparison, as kernel gets bits and vector types have no ==
+
+		if(is_set_[I] && std::memcmp(&cached, &value, sizeof(V)) == 0)
+			return;
+
+		cached = value;
+		is_set_[I] = true;
+		kernel_.addArgument(I, &cached);
+	}
+
+	template<size_t... I>
+	void setArguments(std::index_sequence<I...>, typename KernelArg<Args>::param_type... args){
+		(setArgument<I>(KernelArg<Args>::value(args)), ...);
+	}
+
+public:
+
+	TypedKernel(Program const& prog, const char* name): kernel_(prog, name){
+	}
+
+	void operator()(Queue& queue, NDRange local, NDRange global, typename KernelArg<Args>::param_type... args){
+		setArguments(std::index_sequence_for<Args...>{}, args...);
+
+		queue.execute(); // tasks added before the launch go first
+
+		// empty local range lets implementation choose work-group size
+		cl_int ret = clEnqueueNDRangeKernel(queue.queue(), kernel_.kernel(), global.dimensions(), NULL, global.get(), local.dimensions() ? local.get() : NULL, 0, NULL, NULL);
+		CHECK_ERR(ret, clEnqueueNDRangeKernel);
+
+		kernel_.launched();
+	}
+
+	Kernel const& kernel() const{
+		return kernel_;
+	}
+};
+
+
 
 };
\ No newline at end of file
@@ -1,8 +1,15 @@
 #include "MyFrameCL.hpp"
+#include "random.hpp"
+#include "validate.hpp"
+#include "dataset.hpp"
 #include <cstdlib>
 #include <chrono>
 #include <thread>
 #include <functional>
+#include <memory>
+#include <type_traits>
+#include <algorithm>
+#include <limits>
 /*
 	bitonic.cpp
 
@@ -17,13 +24,18 @@ constexpr size_t VEC_SIZE = 1u << 13;
 enum SortDir{SD_UP, SD_DOWN};
 
 
-void requireSorted(std::vector<int> arr, SortDir sortDir){
-	for(auto it = arr.begin(); it + 1 < arr.end(); it++)
-		if((*it > *(it + 1) && sortDir == SD_UP) || (*it < *(it + 1) && sortDir == SD_DOWN))
-			throw(std::logic_error{"Array is not sorted properly"});
+void requireSorted(std::vector<int> const& arr, SortDir sortDir){
+	myfcl::Validation check = myfcl::hostSorted(arr.data(), arr.size(), sortDir == SD_DOWN);
+
+	if(!check.passed){
+		std::stringstream ss;
+		ss << "Array is not sorted properly (arr[" << check.first_bad << "] = " << arr[check.first_bad]
+		   << ", arr[" << check.first_bad + 1 << "] = " << arr[check.first_bad + 1] << ")";
+		throw(std::logic_error{ss.str()});
+	}
 }
 
-void ref_kernel(std::vector<int>& arr, SortDir sortDir, int i, int j, int range){
+void ref_kernel(int* arr, SortDir sortDir, int i, int j, int range){
 
 	for(int id = 0; id < range; id++){
 		unsigned int id1, id2;
@@ -54,7 +66,41 @@ void ref_kernel(std::vector<int>& arr, SortDir sortDir, int i, int j, int range)
 
 enum ExecPlatform{EP_HOST, EP_OCL};
 
-void bitonic_sort(myfcl::Context const& context, std::vector<int>& array, SortDir sortDir = SD_UP, ExecPlatform platform = EP_OCL) {
+void bitonic_sort(myfcl::Context const& context, myfcl::Queue& queue, myfcl::Buffer<int>& buf, SortDir sortDir = SD_UP){
+
+	// Enqueues sort stages only, the data is expected on device already (or reachable
+	// by it, as a buffer over a mapped dataset is)
+
+	cl_int N = buf.size() / sizeof(int);
+
+	if(N <= 1)
+		return;
+
+	cl_int logN = 0;
+	while((1 << logN) < N) logN++;
+
+	if(1 << logN != N)
+		throw(std::logic_error("Array size must be presisely 2^N"));
+
+	myfcl::Program const& prog = context.getProgram("bitonic_sort.cl");
+	
+	std::string kerName = sortDir == SD_UP ? "sortUp" : "sortDown";
+	
+	myfcl::TypedKernel<myfcl::Buffer<int>, cl_int, cl_int> sort{prog, kerName.c_str()};
+
+	// buffer and i are set once per their change, every stage costs one clSetKernelArg and an enqueue
+
+	size_t half = N / 2;
+
+	for(cl_int i = 0; i < logN; i++)
+		for(cl_int j = 0; j <= i; j++)
+			sort(queue, {half > 8 ? 8: half}, {half}, buf, i, j);
+}
+
+void bitonic_sort(myfcl::Context const& context, std::vector<int>& array, SortDir sortDir = SD_UP, ExecPlatform platform = EP_OCL, myfcl::Queue* queue = nullptr) {
+
+	// Sorts on the given queue (e.g. one of an executor worker) or on a queue of its own
+
 	unsigned int N = array.size();
 
 	if(N <= 1)
@@ -71,59 +117,1020 @@ void bitonic_sort(myfcl::Context const& context, std::vector<int>& array, SortDi
 	if(platform == EP_OCL){
 		myfcl::Buffer<int> buf{context, &array};
 
+		std::unique_ptr<myfcl::Queue> own_queue;
 
-		myfcl::Program prog{context, "bitonic_sort.cl"};
-		
-		std::string kerName = sortDir == SD_UP ? "sortUp" : "sortDown";
-		
-		myfcl::Kernel sort{prog, kerName.c_str()};
-
-		myfcl::Queue queue{context};
-		
-		cl_int i = 0,j = 0;
-
-		sort.addArgument(0, &buf.buffer());
-		sort.addArgument(1, &i);
-		sort.addArgument(2, &j);
+		if(!queue){
+			own_queue = std::make_unique<myfcl::Queue>(context);
+			queue = own_queue.get();
+		}
 
-		queue.addTask(new myfcl::Write{buf});
+		queue->add(myfcl::Write{buf});
 
-		for(i = 0; i < logN; i++)
-			for(j = 0; j <= i; j++){
-				sort.addArgument(1, &i);
-				sort.addArgument(2, &j);
-				queue.addTask(new myfcl::Execute{sort,{N / 2 > 8 ? 8: N / 2}, {N / 2}});
-				queue.execute();
-			}
+		bitonic_sort(context, *queue, buf, sortDir);
 		
-		queue.addTask(new myfcl::Read{buf});
-		queue.execute();
+		queue->add(myfcl::Read{buf});
+		queue->execute();
 
 	}
 	else{
 		for(int i = 0; i < logN; i++)
 			for(int j = 0; j <= i; j++){
-				ref_kernel(array, sortDir, i, j, N / 2);
+				ref_kernel(array.data(), sortDir, i, j, N / 2);
 			}
 
 	}
 }
 
-void performTest(std::string context_name, std::vector<int>* arr){
-	
-	std::cout << "Performing " << context_name << " GPU sorting..." << std::endl;	
 
-	myfcl::Context context{context_name.c_str()};
+#ifdef MYFCL_FAKE_CL
+
+void register_fake_kernels(){
+
+	// Host versions of bitonic_sort.cl kernels for the recording backend
+
+	for(SortDir sortDir: {SD_UP, SD_DOWN})
+		myfcl::fake::registerKernel(sortDir == SD_UP ? "sortUp" : "sortDown", [sortDir](myfcl::fake::Launch const& launch){
+			ref_kernel(launch.buffer<int>(0), sortDir, launch.scalar<cl_int>(1), launch.scalar<cl_int>(2), launch.global(0));
+		});
+}
+
+void performApiBudgetTest(myfcl::Context const& context, unsigned logN){
+
+	// A sort of 2^logN elements: one launch per stage, no rebuilds, a fixed number of host syncs
+
+	register_fake_kernels();
+
+	std::vector<int> arr(1u << logN);
+	myfcl::hostRandomRange(arr.data(), arr.size(), 0, RAND_MAX, 2024);
+
+	context.getProgram("bitonic_sort.cl"); // the only build allowed
+
+	myfcl::fake::Recorder& log = myfcl::fake::recorder();
+	log.reset();
+
+	bitonic_sort(context, arr, SD_UP);
+	requireSorted(arr, SD_UP);
+
+	bitonic_sort(context, arr, SD_DOWN);
+	requireSorted(arr, SD_DOWN);
+
+	std::cout << log.text();
+
+	size_t stages = logN * (logN + 1) / 2;
+
+	if(log.count("clBuildProgram") != 0 || log.count("clCreateProgramWithSource") != 0)
+		throw(std::logic_error{"Sorting rebuilds its program"});
+
+	if(log.launches("sortUp") != stages || log.launches("sortDown") != stages)
+		throw(std::logic_error{"Bitonic sort launches more kernels than it has stages"});
+
+	// per sort: blocking write, blocking read and clFinish of its queue
+
+	if(log.hostSyncs() > 2 * 3)
+		throw(std::logic_error{"Bitonic sort waits for device too often"});
+
+	// buffer once, i per stage group, j at most per stage
+
+	if(log.count("clSetKernelArg") > 2 * (stages + logN + 1))
+		throw(std::logic_error{"Bitonic sort sets unchanged kernel arguments"});
+
+	if(log.bytes("clEnqueueWriteBuffer") != arr.size() * sizeof(int) * 2 || log.bytes("clEnqueueReadBuffer") != arr.size() * sizeof(int) * 2)
+		throw(std::logic_error{"Bitonic sort moves more data than the array"});
+
+	std::cout << "API budget test passed" << std::endl;
+}
+
+#endif
+
+std::future<std::vector<int>> bitonic_sort_async(myfcl::Context const& context, myfcl::Queue& queue, std::vector<int> array, SortDir sortDir = SD_UP){
+
+	// Enqueues the sort and returns at once, array is given back sorted through the future
+	// resolved by an event callback, so the caller is free to do host work meanwhile
+
+	if(array.size() <= 1){
+		std::promise<std::vector<int>> done;
+		done.set_value(std::move(array));
+		return done.get_future();
+	}
+
+	if(array.size() & (array.size() - 1)) // checked before anything is queued
+		throw(std::logic_error("Array size must be presisely 2^N"));
+
+	struct State{ // lives until the callback, host data and buffer of the sort in flight
+		std::vector<int> data;
+		myfcl::Buffer<int> buf;
+
+		State(myfcl::Context const& context, std::vector<int>&& array): data(std::move(array)), buf{context, &data}{
+		}
+	};
+
+	auto state = std::make_shared<State>(context, std::move(array));
+
+	queue.add(myfcl::WriteAsync{state->buf});
+
+	bitonic_sort(context, queue, state->buf, sortDir); // stages follow the upload
+
+	queue.add(myfcl::ReadAsync{state->buf});
+
+	return queue.whenDone([state]{
+		return std::move(state->data);
+	});
+}
+
+void partitioned_sort(myfcl::Context const& context, std::vector<int>& array, SortDir sortDir = SD_UP){
+
+	// Every context device (partition of a multi-socket CPU) sorts its own share of the array
+	// on its own queue, so the share is first touched and sorted on one memory node. Shares are
+	// padded to 2^N for bitonic sort and the sorted runs are merged on host
+
+	auto queues = myfcl::deviceQueues(context);
+
+	size_t parts = std::min(queues.size(), std::max<size_t>(array.size(), 1));
+
+	int sentinel = sortDir == SD_UP ? std::numeric_limits<int>::max() : std::numeric_limits<int>::min();
+
+	std::vector<std::future<std::vector<int>>> sorted;
+	std::vector<size_t> bounds{0};
+
+	for(size_t p = 0; p < parts; p++){
+		size_t first = bounds.back(), last = (p + 1) * array.size() / parts;
+		bounds.push_back(last);
+
+		size_t padded = 1;
+		while(padded < last - first)
+			padded <<= 1;
+
+		std::vector<int> share(padded, sentinel); // padding goes to the end of the sorted share
+		std::copy(array.begin() + first, array.begin() + last, share.begin());
+
+		sorted.push_back(bitonic_sort_async(context, *queues[p], std::move(share), sortDir));
+	}
+
+	for(size_t p = 0; p < parts; p++){
+		std::vector<int> share = sorted[p].get();
+		std::copy(share.begin(), share.begin() + (bounds[p + 1] - bounds[p]), array.begin() + bounds[p]);
+	}
+
+	auto order = [sortDir](int a, int b){ return sortDir == SD_UP ? a < b : a > b; };
+
+	for(size_t p = 1; p < parts; p++)
+		std::inplace_merge(array.begin(), array.begin() + bounds[p], array.begin() + bounds[p + 1], order);
+}
+
+// LSD radix sort, kernels are in radix_sort.cl
+
+enum { RADIX_BITS = 4, RADIX = 1 << RADIX_BITS, RADIX_GROUP_SIZE = 256 };
+
+template<typename K>
+struct radix_key_traits{
+
+};
+
+template<>
+struct radix_key_traits<cl_int>{
+	using bits_type = cl_uint;
+	static constexpr bits_type sign_mask = 0x80000000u;
+	static constexpr const char* histogram = "radix_histogram_32";
+	static constexpr const char* scatter = "radix_scatter_32";
+};
+
+template<>
+struct radix_key_traits<cl_uint>{
+	using bits_type = cl_uint;
+	static constexpr bits_type sign_mask = 0u;
+	static constexpr const char* histogram = "radix_histogram_32";
+	static constexpr const char* scatter = "radix_scatter_32";
+};
+
+template<>
+struct radix_key_traits<cl_long>{
+	using bits_type = cl_ulong;
+	static constexpr bits_type sign_mask = 0x8000000000000000ull;
+	static constexpr const char* histogram = "radix_histogram_64";
+	static constexpr const char* scatter = "radix_scatter_64";
+};
+
+template<>
+struct radix_key_traits<cl_ulong>{
+	using bits_type = cl_ulong;
+	static constexpr bits_type sign_mask = 0ull;
+	static constexpr const char* histogram = "radix_histogram_64";
+	static constexpr const char* scatter = "radix_scatter_64";
+};
+
+
+class DeviceScan{
+
+	// Exclusive scan of cl_uint buffer on device
+	// Every level writes per-block sums, which are scanned recursively and added back
+
+	myfcl::Kernel scan_;
+	myfcl::Kernel add_;
+	std::vector<std::unique_ptr<myfcl::Buffer<cl_uint>>> sums_;
+
+	void run(myfcl::Queue& queue, cl_mem* data, cl_uint n, size_t level){
+		cl_uint groups = (n + RADIX_GROUP_SIZE - 1) / RADIX_GROUP_SIZE;
+
+		scan_.addArgument(0, data);
+		scan_.addArgument(1, &sums_[level]->buffer());
+		scan_.addArgument(2, &n);
+		queue.add(myfcl::Execute{scan_, {RADIX_GROUP_SIZE}, {groups * RADIX_GROUP_SIZE}});
+		queue.execute();
+
+		if(groups == 1)
+			return;
+
+		run(queue, &sums_[level]->buffer(), groups, level + 1);
+
+		add_.addArgument(0, data);
+		add_.addArgument(1, &sums_[level]->buffer());
+		add_.addArgument(2, &n);
+		queue.add(myfcl::Execute{add_, {RADIX_GROUP_SIZE}, {groups * RADIX_GROUP_SIZE}});
+		queue.execute();
+	}
+
+public:
+	DeviceScan(myfcl::Context const& context, myfcl::Program const& prog, cl_uint n): scan_{prog, "scan_block"}, add_{prog, "scan_add"}{
+		cl_uint len = n;
+		do{
+			len = (len + RADIX_GROUP_SIZE - 1) / RADIX_GROUP_SIZE;
+			sums_.emplace_back(std::make_unique<myfcl::Buffer<cl_uint>>(context, len));
+		} while(len > 1);
+	}
+
+	void run(myfcl::Queue& queue, myfcl::Buffer<cl_uint>& data, cl_uint n){
+		run(queue, &data.buffer(), n, 0);
+	}
+};
+
+
+template<typename K>
+void ref_radix_sort(std::vector<K>& keys, std::vector<cl_uint>* values, typename radix_key_traits<K>::bits_type flip){
+
+	// Host version of the same LSD passes, stable counting sort by every digit
+
+	using bits_type = typename radix_key_traits<K>::bits_type;
+
+	std::vector<K> keys_tmp(keys.size());
+	std::vector<cl_uint> vals_tmp(values ? values->size() : 0);
+
+	for(unsigned shift = 0; shift < sizeof(K) * 8; shift += RADIX_BITS){
+		auto digit = [&](K key){ return (cl_uint)(((static_cast<bits_type>(key) ^ flip) >> shift) & (RADIX - 1)); };
+
+		size_t offsets[RADIX] = {};
+		for(auto key: keys)
+			offsets[digit(key)]++;
+
+		for(size_t d = 0, sum = 0; d < RADIX; d++){
+			size_t count = offsets[d];
+			offsets[d] = sum;
+			sum += count;
+		}
+
+		for(size_t i = 0; i < keys.size(); i++){
+			size_t dst = offsets[digit(keys[i])]++;
+			keys_tmp[dst] = keys[i];
+			if(values)
+				vals_tmp[dst] = (*values)[i];
+		}
+
+		keys.swap(keys_tmp);
+		if(values)
+			values->swap(vals_tmp);
+	}
+}
+
+template<typename K>
+void radix_sort(myfcl::Context const& context, std::vector<K>& keys, SortDir sortDir = SD_UP, ExecPlatform platform = EP_OCL, std::vector<cl_uint>* values = nullptr){
+
+	// Stable sort of 32/64-bit keys, values (if given) are permuted along with keys
+
+	using traits = radix_key_traits<K>;
+	using bits_type = typename traits::bits_type;
+
+	if(values && values->size() != keys.size())
+		throw(std::logic_error("Keys and values must have the same size"));
+
+	cl_uint N = keys.size();
+
+	if(N <= 1)
+		return;
+
+	// ascending order of (key ^ flip) taken as unsigned is the requested order of keys
+
+	bits_type flip = sortDir == SD_UP ? traits::sign_mask : ~traits::sign_mask;
+
+	if(platform == EP_HOST){
+		ref_radix_sort(keys, values, flip);
+		return;
+	}
+
+	constexpr cl_uint passes = sizeof(K) * 8 / RADIX_BITS; // even, so result ends up in the source buffers
+
+	cl_uint groups = (N + RADIX_GROUP_SIZE - 1) / RADIX_GROUP_SIZE;
+	cl_uint hist_size = RADIX * groups;
+
+	myfcl::Buffer<K> keysA{context, &keys};
+	myfcl::Buffer<K> keysB{context, N};
+	std::unique_ptr<myfcl::Buffer<cl_uint>> valsA, valsB;
+	myfcl::Buffer<cl_uint> hist{context, hist_size};
+
+	if(values){
+		valsA = std::make_unique<myfcl::Buffer<cl_uint>>(context, values);
+		valsB = std::make_unique<myfcl::Buffer<cl_uint>>(context, N);
+	}
+
+	myfcl::Program const& prog = context.getProgram("radix_sort.cl");
+	myfcl::Kernel histogram{prog, traits::histogram};
+	myfcl::Kernel scatter{prog, traits::scatter};
+	DeviceScan scan{context, prog, hist_size};
+
+	myfcl::Queue queue{context};
+
+	cl_mem no_values = NULL;
+	cl_mem* keys_mem[2] = {&keysA.buffer(), &keysB.buffer()};
+	cl_mem* vals_mem[2] = {values ? &valsA->buffer() : &no_values, values ? &valsB->buffer() : &no_values};
+
+	queue.add(myfcl::Write{keysA});
+	if(values)
+		queue.add(myfcl::Write{*valsA});
+	queue.execute();
+
+	histogram.addArgument(1, &N);
+	histogram.addArgument(2, &flip);
+	histogram.addArgument(4, &hist.buffer());
+
+	scatter.addArgument(4, &N);
+	scatter.addArgument(5, &flip);
+	scatter.addArgument(7, &hist.buffer());
+
+	for(cl_uint pass = 0; pass < passes; pass++){
+		cl_uint shift = pass * RADIX_BITS;
+		cl_uint src = pass % 2, dst = 1 - src;
+
+		histogram.addArgument(0, keys_mem[src]);
+		histogram.addArgument(3, &shift);
+		queue.add(myfcl::Execute{histogram, {RADIX_GROUP_SIZE}, {groups * RADIX_GROUP_SIZE}});
+		queue.execute();
+
+		scan.run(queue, hist, hist_size);
+
+		scatter.addArgument(0, keys_mem[src]);
+		scatter.addArgument(1, keys_mem[dst]);
+		scatter.addArgument(2, vals_mem[src]);
+		scatter.addArgument(3, vals_mem[dst]);
+		scatter.addArgument(6, &shift);
+		queue.add(myfcl::Execute{scatter, {RADIX_GROUP_SIZE}, {groups * RADIX_GROUP_SIZE}});
+		queue.execute();
+	}
+
+	queue.add(myfcl::Read{keysA});
+	if(values)
+		queue.add(myfcl::Read{*valsA});
+	queue.execute();
+}
+
+
+enum SortAlgorithm{SA_BITONIC, SA_RADIX};
+
+constexpr size_t BITONIC_MAX_SIZE = 1u << 16; // above that log^2(N) bitonic stages lose to radix passes
+
+template<typename K>
+SortAlgorithm choose_sort_algorithm(size_t N){
+
+	// bitonic sort handles only int arrays of 2^n size
+
+	bool pow2 = N != 0 && (N & (N - 1)) == 0;
+
+	if(std::is_same_v<K, int> && pow2 && N <= BITONIC_MAX_SIZE)
+		return SA_BITONIC;
+
+	return SA_RADIX;
+}
+
+template<typename K>
+void sort_array(myfcl::Context const& context, std::vector<K>& keys, SortDir sortDir = SD_UP, ExecPlatform platform = EP_OCL, std::vector<cl_uint>* values = nullptr){
+
+	// Sort front-end: picks bitonic or radix sort by key type and size
+
+	if constexpr(std::is_same_v<K, int>){
+		if(!values && choose_sort_algorithm<K>(keys.size()) == SA_BITONIC){
+			bitonic_sort(context, keys, sortDir, platform);
+			return;
+		}
+	}
+
+	radix_sort(context, keys, sortDir, platform, values);
+}
+
+template<typename K>
+K random_key(){
+	K key = static_cast<K>(rand());
+	for(size_t i = 1; i < sizeof(K) / 2; i++)
+		key = static_cast<K>((key << 16) ^ rand());
+	return key;
+}
+
+template<typename K>
+void performRadixTest(myfcl::Context const& context, size_t size, SortDir sortDir){
+
+	// Compares device radix sort of keys with payload against host stable sort
+
+	std::vector<K> keys(size);
+	std::vector<cl_uint> values(size);
+
+	for(size_t i = 0; i < size; i++){
+		keys[i] = random_key<K>();
+		values[i] = i;
+	}
+
+	std::vector<std::pair<K, cl_uint>> ref(size);
+	for(size_t i = 0; i < size; i++)
+		ref[i] = {keys[i], values[i]};
+
+	std::stable_sort(ref.begin(), ref.end(), [sortDir](auto const& a, auto const& b){
+		return sortDir == SD_UP ? a.first < b.first : a.first > b.first;
+	});
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	sort_array(context, keys, sortDir, EP_OCL, &values);
+
+	auto finish = std::chrono::high_resolution_clock::now();
+
+	std::chrono::duration<double> fs = finish - start;
+
+	for(size_t i = 0; i < size; i++)
+		if(keys[i] != ref[i].first || values[i] != ref[i].second)
+			throw(std::logic_error{"Radix sort result differs from reference"});
+
+	std::cout << sizeof(K) * 8 << "-bit keys with payload (" << size << " elements) sorted in " << fs.count() << " seconds" << std::endl;
+}
+
+// Segmented sort of many short arrays packed into one buffer
+
+enum { SEGMENT_MAX_SIZE = 2048, SEGMENT_GROUP_SIZE = 256 };
+
+void segmented_sort(myfcl::Context const& context, std::vector<int>& array, std::vector<int> const& offsets, SortDir sortDir = SD_UP, ExecPlatform platform = EP_OCL){
+
+	// Segment s is array[offsets[s]..offsets[s + 1]), each one is sorted by its own work-group
+	// The whole batch is a single submission
+
+	if(offsets.size() < 2)
+		return;
+
+	size_t max_len = 0;
+
+	for(size_t s = 0; s + 1 < offsets.size(); s++){
+		if(offsets[s] < 0 || offsets[s] > offsets[s + 1] || static_cast<size_t>(offsets[s + 1]) > array.size())
+			throw(std::logic_error("Segment offsets must be non-decreasing and lie within array"));
+
+		max_len = std::max(max_len, static_cast<size_t>(offsets[s + 1] - offsets[s]));
+	}
+
+	if(max_len > SEGMENT_MAX_SIZE)
+		throw(std::logic_error("Segment is too long for segmented sort"));
+
+	size_t segments = offsets.size() - 1;
+
+	if(platform == EP_HOST){
+		for(size_t s = 0; s < segments; s++){
+			if(sortDir == SD_UP)
+				std::sort(array.begin() + offsets[s], array.begin() + offsets[s + 1]);
+			else
+				std::sort(array.begin() + offsets[s], array.begin() + offsets[s + 1], std::greater<int>{});
+		}
+		return;
+	}
+
+	// one work-item per compare-exchange of the longest segment
+
+	size_t work_group_size = 1;
+	while(work_group_size * 2 < max_len && work_group_size < SEGMENT_GROUP_SIZE)
+		work_group_size <<= 1;
+
+	myfcl::Buffer<int> buf{context, &array};
+	myfcl::Buffer<int> offBuf{context, offsets.size(), CL_MEM_READ_ONLY};
+
+	std::copy(offsets.begin(), offsets.end(), offBuf.begin());
+
+	myfcl::Program const& prog = context.getProgram("bitonic_sort.cl");
+	myfcl::Kernel sort{prog, "segmented_sort"};
+
+	myfcl::Queue queue{context};
+
+	cl_int up = sortDir == SD_UP;
+
+	sort.addArgument(0, &buf.buffer());
+	sort.addArgument(1, &offBuf.buffer());
+	sort.addArgument(2, &up);
+
+	queue.add(myfcl::Write{buf});
+	queue.add(myfcl::Write{offBuf});
+	queue.add(myfcl::Execute{sort, {work_group_size}, {segments * work_group_size}});
+	queue.add(myfcl::Read{buf});
+	queue.execute();
+}
+
+void performSegmentedTest(myfcl::Context const& context, size_t segments, size_t max_len){
+
+	// Sorts batch of random segments in one launch and compares rate with sorting them one by one
+
+	std::vector<int> offsets(segments + 1);
+	offsets[0] = 0;
+
+	for(size_t s = 0; s < segments; s++)
+		offsets[s + 1] = offsets[s] + 1 + rand() % max_len;
+
+	std::vector<int> arr(offsets.back());
+	for(auto&& i: arr)
+		i = rand() - RAND_MAX / 2;
+
+	std::vector<int> ref = arr;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	segmented_sort(context, arr, offsets, SD_DOWN);
+
+	auto finish = std::chrono::high_resolution_clock::now();
+
+	std::chrono::duration<double> batched = finish - start;
+
+	segmented_sort(context, ref, offsets, SD_DOWN, EP_HOST);
+
+	if(arr != ref)
+		throw(std::logic_error{"Segmented sort result differs from reference"});
+
+	// sorting segments separately is far slower, so only a sample of them is timed
+
+	size_t sample = std::min<size_t>(segments, 16);
+
+	start = std::chrono::high_resolution_clock::now();
+
+	for(size_t s = 0; s < sample; s++){
+		std::vector<int> one(ref.begin() + offsets[s], ref.begin() + offsets[s + 1]);
+		sort_array(context, one, SD_DOWN);
+	}
+
+	finish = std::chrono::high_resolution_clock::now();
+
+	std::chrono::duration<double> separate = finish - start;
+
+	std::cout << segments << " segments: " << segments / batched.count() << " sorts/s batched, " 
+			  << sample / separate.count() << " sorts/s one by one" << std::endl;
+}
+
+
+// Top-k selection, only k best elements are sorted and read back
+
+enum { TOPK_MAX_SIZE = 2048, TOPK_GROUP_SIZE = 256 };
+
+std::vector<int> top_k(myfcl::Context const& context, std::vector<int>& keys, size_t k, SortDir sortDir = SD_UP, ExecPlatform platform = EP_OCL,
+					   std::vector<int>* values = nullptr, std::vector<int>* top_values = nullptr){
+
+	// Returns k smallest (SD_UP) or largest (SD_DOWN) keys in sortDir order
+	// If values are given, matching values are stored in top_values
+
+	if(values && values->size() != keys.size())
+		throw(std::logic_error("Keys and values must have the same size"));
+
+	k = std::min(k, keys.size());
+
+	if(k == 0)
+		return {};
+
+	if(platform == EP_HOST){
+		std::vector<size_t> idx(keys.size());
+		for(size_t i = 0; i < idx.size(); i++)
+			idx[i] = i;
+
+		std::partial_sort(idx.begin(), idx.begin() + k, idx.end(), [&keys, sortDir](size_t a, size_t b){
+			return sortDir == SD_UP ? keys[a] < keys[b] : keys[a] > keys[b];
+		});
+
+		std::vector<int> ret(k);
+		if(top_values)
+			top_values->resize(k);
+
+		for(size_t i = 0; i < k; i++){
+			ret[i] = keys[idx[i]];
+			if(values && top_values)
+				(*top_values)[i] = (*values)[idx[i]];
+		}
+		return ret;
+	}
+
+	cl_uint K = 1;
+	while(K < k) K <<= 1;
+
+	if(2 * K > TOPK_MAX_SIZE)
+		throw(std::logic_error("k is too big for top-k selection"));
+
+	cl_uint N = keys.size();
+	cl_uint groups = (N + 2 * K - 1) / (2 * K);
+
+	size_t work_group_size = std::min<size_t>(K, TOPK_GROUP_SIZE);
+
+	myfcl::Buffer<int> keysIn{context, &keys, CL_MEM_READ_ONLY};
+	myfcl::Buffer<int> keysA{context, groups * K};
+	myfcl::Buffer<int> keysB{context, groups * K};
+	std::unique_ptr<myfcl::Buffer<int>> valsIn, valsA, valsB;
+
+	if(values){
+		valsIn = std::make_unique<myfcl::Buffer<int>>(context, values, CL_MEM_READ_ONLY);
+		valsA = std::make_unique<myfcl::Buffer<int>>(context, groups * K);
+		valsB = std::make_unique<myfcl::Buffer<int>>(context, groups * K);
+	}
+
+	myfcl::Program const& prog = context.getProgram("bitonic_sort.cl");
+	myfcl::Kernel reduce{prog, "topk_reduce"};
+
+	myfcl::Queue queue{context};
+
+	cl_mem no_values = NULL;
+	cl_mem* keys_mem[3] = {&keysIn.buffer(), &keysA.buffer(), &keysB.buffer()};
+	cl_mem* vals_mem[3] = {&no_values, &no_values, &no_values};
+
+	if(values){
+		vals_mem[0] = &valsIn->buffer();
+		vals_mem[1] = &valsA->buffer();
+		vals_mem[2] = &valsB->buffer();
+	}
+
+	cl_int up = sortDir == SD_UP;
+
+	reduce.addArgument(5, &K);
+	reduce.addArgument(6, &up);
+
+	queue.add(myfcl::Write{keysIn});
+	if(values)
+		queue.add(myfcl::Write{*valsIn});
+	queue.execute();
+
+	// first launch sorts blocks of 2K, later ones only merge pairs of sorted K-runs
+
+	cl_uint n = N;
+	cl_int sorted_runs = 0;
+	int src = 0, dst = 1;
+
+	while(true){
+		cl_uint launch_groups = (n + 2 * K - 1) / (2 * K);
+
+		reduce.addArgument(0, keys_mem[src]);
+		reduce.addArgument(1, vals_mem[src]);
+		reduce.addArgument(2, &n);
+		reduce.addArgument(3, keys_mem[dst]);
+		reduce.addArgument(4, vals_mem[dst]);
+		reduce.addArgument(7, &sorted_runs);
+		queue.add(myfcl::Execute{reduce, {work_group_size}, {launch_groups * work_group_size}});
+		queue.execute();
+
+		if(launch_groups == 1)
+			break;
+
+		// last run keeps valid elements first, its padding is read as padding again
+
+		n = (launch_groups - 1) * K + std::min<cl_uint>(K, n - (launch_groups - 1) * 2 * K);
+		sorted_runs = 1;
+		src = dst;
+		dst = dst == 1 ? 2 : 1;
+	}
+
+	myfcl::Buffer<int>& top_keys = dst == 1 ? keysA : keysB;
+
+	queue.add(myfcl::Read{top_keys, k});
+	if(values && top_values)
+		queue.add(myfcl::Read{dst == 1 ? *valsA : *valsB, k});
+	queue.execute();
+
+	if(values && top_values)
+		top_values->assign((dst == 1 ? *valsA : *valsB).begin(), (dst == 1 ? *valsA : *valsB).begin() + k);
+
+	return std::vector<int>(top_keys.begin(), top_keys.begin() + k);
+}
+
+void performTopKTest(myfcl::Context const& context, size_t size, size_t k, SortDir sortDir, bool worst_keys = false){
+
+	// Checks top-k keys against host partial sort and values against source positions
+	// With worst_keys half of the keys equal padding (INT_MAX up, INT_MIN down), so padding has to lose ties
+
+	std::vector<int> keys(size);
+	std::vector<int> values(size);
+
+	for(size_t i = 0; i < size; i++){
+		keys[i] = worst_keys && i % 2 ? (sortDir == SD_UP ? INT_MAX : INT_MIN) : rand() - RAND_MAX / 2;
+		values[i] = i;
+	}
+
+	std::vector<int> top_values;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<int> top = top_k(context, keys, k, sortDir, EP_OCL, &values, &top_values);
+
+	auto finish = std::chrono::high_resolution_clock::now();
+
+	std::chrono::duration<double> fs = finish - start;
+
+	std::vector<int> ref = top_k(context, keys, k, sortDir, EP_HOST);
+
+	if(top != ref)
+		throw(std::logic_error{"Top-k keys differ from reference"});
+
+	for(size_t i = 0; i < top.size(); i++)
+		if(top_values[i] < 0 || keys[top_values[i]] != top[i])
+			throw(std::logic_error{"Top-k values do not match keys"});
+
+	std::cout << "Top " << k << " of " << size << " elements selected in " << fs.count() << " seconds" << std::endl;
+}
+
+// Merge of sorted arrays with merge path, kernels are in merge_path.cl
+
+enum { MERGE_ITEMS = 8, MERGE_GROUP_SIZE = 128 };
+
+template<typename T>
+struct merge_kernel{
+
+};
+
+template<>
+struct merge_kernel<int>{
+	static constexpr const char* partition = "merge_partition_int";
+	static constexpr const char* merge = "merge_path_int";
+};
+
+template<>
+struct merge_kernel<float>{
+	static constexpr const char* partition = "merge_partition_float";
+	static constexpr const char* merge = "merge_path_float";
+};
+
+template<typename T>
+void enqueue_merge(myfcl::Context const& context, myfcl::Program const& prog, myfcl::Queue& queue,
+				   myfcl::Buffer<T>& a, cl_uint na, myfcl::Buffer<T>& b, cl_uint nb, myfcl::Buffer<T>& out, SortDir sortDir){
+
+	// Merges first na elements of a and first nb elements of b into out without reading anything back
+
+	cl_uint items_per_group = MERGE_GROUP_SIZE * MERGE_ITEMS;
+	cl_uint groups = (na + nb + items_per_group - 1) / items_per_group;
+
+	if(groups == 0)
+		return;
+
+	myfcl::Buffer<cl_uint> partitions{context, groups + 1};
+
+	myfcl::Kernel partition{prog, merge_kernel<T>::partition};
+	myfcl::Kernel merge{prog, merge_kernel<T>::merge};
+
+	cl_int up = sortDir == SD_UP;
+
+	partition.addArgument(0, &a.buffer());
+	partition.addArgument(1, &na);
+	partition.addArgument(2, &b.buffer());
+	partition.addArgument(3, &nb);
+	partition.addArgument(4, &partitions.buffer());
+	partition.addArgument(5, &items_per_group);
+	partition.addArgument(6, &up);
+
+	merge.addArgument(0, &a.buffer());
+	merge.addArgument(1, &na);
+	merge.addArgument(2, &b.buffer());
+	merge.addArgument(3, &nb);
+	merge.addArgument(4, &out.buffer());
+	merge.addArgument(5, &partitions.buffer());
+	merge.addArgument(6, &up);
+
+	queue.add(myfcl::Execute{partition, {}, {groups + 1}});
+	queue.add(myfcl::Execute{merge, {MERGE_GROUP_SIZE}, {groups * MERGE_GROUP_SIZE}});
+	queue.execute();
+}
+
+template<typename T>
+std::vector<T> merge_sorted(myfcl::Context const& context, std::vector<T>& a, std::vector<T>& b, SortDir sortDir = SD_UP, ExecPlatform platform = EP_OCL){
+
+	// Merges two arrays sorted in sortDir order, equal elements of a go first
+
+	std::vector<T> ret(a.size() + b.size());
+
+	if(platform == EP_HOST){
+		if(sortDir == SD_UP)
+			std::merge(a.begin(), a.end(), b.begin(), b.end(), ret.begin());
+		else
+			std::merge(a.begin(), a.end(), b.begin(), b.end(), ret.begin(), std::greater<T>{});
+		return ret;
+	}
+
+	if(ret.empty())
+		return ret;
+
+	// zero-sized buffers are not allowed, so empty inputs get a dummy element
+
+	std::vector<T> dummy(1);
+
+	myfcl::Buffer<T> bufA{context, a.empty() ? &dummy : &a, CL_MEM_READ_ONLY};
+	myfcl::Buffer<T> bufB{context, b.empty() ? &dummy : &b, CL_MEM_READ_ONLY};
+	myfcl::Buffer<T> bufOut{context, &ret};
+
+	myfcl::Program const& prog = context.getProgram("merge_path.cl");
+
+	myfcl::Queue queue{context};
+
+	queue.add(myfcl::Write{bufA});
+	queue.add(myfcl::Write{bufB});
+	queue.execute();
+
+	enqueue_merge(context, prog, queue, bufA, a.size(), bufB, b.size(), bufOut, sortDir);
+
+	queue.add(myfcl::Read{bufOut});
+	queue.execute();
+
+	return ret;
+}
+
+template<typename T>
+class SortedIndex{
+
+	// Device resident sorted array, new batches are sorted and merged into it on device
+
+	myfcl::Context const& context_;
+	SortDir sortDir_;
+	myfcl::Program const& prog_;
+	myfcl::Queue queue_;
+
+	std::unique_ptr<myfcl::Buffer<T>> data_, spare_;
+	cl_uint size_ = 0;
+
+	static size_t capacity(std::unique_ptr<myfcl::Buffer<T>> const& buf){
+		return buf ? buf->size() / sizeof(T) : 0;
+	}
+
+	void reserve(std::unique_ptr<myfcl::Buffer<T>>& buf, size_t size){
+		if(capacity(buf) < size)
+			buf = std::make_unique<myfcl::Buffer<T>>(context_, std::max(size, 2 * capacity(buf)));
+	}
+
+	void sortBatch(std::vector<T>& batch){
+		if constexpr(std::is_same_v<T, float>){
+			if(sortDir_ == SD_UP)
+				std::sort(batch.begin(), batch.end());
+			else
+				std::sort(batch.begin(), batch.end(), std::greater<T>{});
+		}
+		else
+			sort_array(context_, batch, sortDir_);
+	}
+
+public:
+	SortedIndex(myfcl::Context const& context, SortDir sortDir = SD_UP): context_(context), sortDir_(sortDir), prog_(context.getProgram("merge_path.cl")), queue_{context}{
+	}
+
+	void insert(std::vector<T> batch){
+		if(batch.empty())
+			return;
+
+		sortBatch(batch);
+
+		cl_uint nb = batch.size();
+
+		if(size_ == 0){
+			reserve(data_, nb);
+			std::copy(batch.begin(), batch.end(), data_->begin());
+			queue_.add(myfcl::Write{*data_, nb});
+			queue_.execute();
+			size_ = nb;
+			return;
+		}
+
+		myfcl::Buffer<T> batchBuf{context_, &batch, CL_MEM_READ_ONLY};
+
+		reserve(spare_, size_ + nb);
+
+		queue_.add(myfcl::Write{batchBuf});
+		queue_.execute();
+
+		enqueue_merge(context_, prog_, queue_, *data_, size_, batchBuf, nb, *spare_, sortDir_);
+
+		std::swap(data_, spare_);
+		size_ += nb;
+	}
+
+	cl_uint size() const{
+		return size_;
+	}
+
+	std::vector<T> read(){
+		if(size_ == 0)
+			return {};
+
+		queue_.add(myfcl::Read{*data_, size_});
+		queue_.execute();
+
+		return std::vector<T>(data_->begin(), data_->begin() + size_);
+	}
+};
+
+template<typename T>
+void performMergeTest(myfcl::Context const& context, size_t sizeA, size_t sizeB, SortDir sortDir){
+
+	// Checks device merge against std::merge
+
+	std::vector<T> a(sizeA), b(sizeB);
+
+	for(auto&& i: a)
+		i = static_cast<T>(rand() % 1000);
+	for(auto&& i: b)
+		i = static_cast<T>(rand() % 1000);
+
+	auto cmp = [sortDir](T x, T y){ return sortDir == SD_UP ? x < y : x > y; };
+
+	std::sort(a.begin(), a.end(), cmp);
+	std::sort(b.begin(), b.end(), cmp);
 
 	auto start = std::chrono::high_resolution_clock::now();
 
-	bitonic_sort(context, *arr);
+	std::vector<T> merged = merge_sorted(context, a, b, sortDir);
 
 	auto finish = std::chrono::high_resolution_clock::now();
 
 	std::chrono::duration<double> fs = finish - start;
 
-	std::cout << context_name << " finished in " << fs.count() << " seconds" << std::endl;
+	if(merged != merge_sorted(context, a, b, sortDir, EP_HOST))
+		throw(std::logic_error{"Merged array differs from reference"});
+
+	std::cout << sizeA << " + " << sizeB << " elements merged in " << fs.count() << " seconds" << std::endl;
+}
+
+void performSortedIndexTest(myfcl::Context const& context, size_t batches, size_t batch_size){
+
+	// Builds index from incrementally arriving batches and compares with sorting everything at once
+
+	SortedIndex<int> index{context, SD_DOWN};
+	std::vector<int> all;
+
+	for(size_t i = 0; i < batches; i++){
+		std::vector<int> batch(batch_size + rand() % batch_size);
+		for(auto&& j: batch)
+			j = rand() - RAND_MAX / 2;
+
+		all.insert(all.end(), batch.begin(), batch.end());
+		index.insert(std::move(batch));
+	}
+
+	std::sort(all.begin(), all.end(), std::greater<int>{});
+
+	if(index.read() != all)
+		throw(std::logic_error{"Sorted index differs from reference"});
+
+	std::cout << "Sorted index of " << index.size() << " elements built from " << batches << " batches" << std::endl;
+}
+
+constexpr size_t RANDOM_CHECK_SIZE = 1u << 16; // head of device random stream compared to host one
+
+std::future<double> performTest(myfcl::Context const& context, myfcl::Executor& executor, std::string name, size_t size,
+								std::vector<int> const* expected){
+
+	// Sort job for a worker of the shared executor, resolves to its time in seconds
+	// Data is generated on device and sorted in place, only the head of the fill is read back
+	// to be compared with host stream in expected
+
+	std::cout << "Submitting " << name << " GPU sorting..." << std::endl;
+
+	return executor.submit([&context, name, size, expected](myfcl::Queue& queue){
+		myfcl::Buffer<int> buf{context, size};
+
+		myfcl::randomRange(context, queue, buf, 0, RAND_MAX, 2024);
+
+		size_t head = std::min(size, expected->size());
+
+		queue.add(myfcl::Read{buf, head});
+		queue.execute();
+
+		if(!std::equal(buf.begin(), buf.begin() + head, expected->begin()))
+			throw(std::logic_error{"Device random numbers differ from host ones"});
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		bitonic_sort(context, queue, buf, SD_UP);
+		queue.execute();
+
+		cl_int ret = myfcl::waitQueue(queue.queue());
+		if(ret != CL_SUCCESS)
+			throw(myfcl::Exception{"clFinish", ret, __LINE__, __FILE__});
+
+		std::chrono::duration<double> fs = std::chrono::high_resolution_clock::now() - start;
+
+		myfcl::Validation sorted = myfcl::deviceSorted(context, queue, buf);
+
+		if(!sorted.passed){
+			std::stringstream ss;
+			ss << name << " sort failed at element " << sorted.first_bad;
+			throw(std::logic_error{ss.str()});
+		}
+
+		std::cout << name << " finished in " << fs.count() << " seconds" << std::endl;
+
+		return fs.count();
+	});
 }
 
 int main(int argc, char** argv){
@@ -144,38 +1151,174 @@ int main(int argc, char** argv){
 	
 	try{
 			
-		std::vector<int> arr(VEC_SIZE);
-		std::vector<int> arr2(VEC_SIZE);
-		std::vector<int> arr3(VEC_SIZE);
+		// one context and its programs serve all concurrent jobs
 
-		for(int i = 0; i < VEC_SIZE; i++){
-			arr[i] = rand();
-		}
+		// MYFCL_METRICS names a file to refresh with framework metrics every second
 
-		std::copy(arr.begin(), arr.end(), arr2.begin());
-		std::copy(arr.begin(), arr.end(), arr3.begin());
-		
-		std::thread nvidiaTest{performTest, std::string("NVIDIA"), &arr};
-		std::thread intelTest{performTest, std::string("Intel"), &arr2};
+		std::unique_ptr<myfcl::MetricsDump> metrics_dump;
+
+		if(const char* path = std::getenv("MYFCL_METRICS"))
+			metrics_dump = std::make_unique<myfcl::MetricsDump>(path, std::chrono::seconds{1});
+
+		myfcl::Context context{myfcl::bestDevice()};
+
+	#ifdef MYFCL_FAKE_CL
+		// the recording backend has host versions of the bitonic kernels only
+
+		performApiBudgetTest(context, std::min(logN, 20u));
+		return 0;
+	#endif
+
+		context.warmUp({{"radix_sort.cl", ""}, {"bitonic_sort.cl", ""}, {"merge_path.cl", ""}, {"random.cl", ""}});
+
+		// host stream is generated only for the head the jobs compare their device fill with
 
-		std::sort(arr3.begin(), arr3.end(), [](int a, int b)->bool{ return a < b;});
+		std::vector<int> expected(std::min<size_t>(VEC_SIZE, RANDOM_CHECK_SIZE));
 
-		nvidiaTest.join();
-		intelTest.join();
+		myfcl::hostRandomRange(expected.data(), expected.size(), 0, RAND_MAX, 2024);
 
-		requireSorted(arr3, SD_UP);
+		myfcl::Executor executor{context, 2};
 
-		requireSorted(arr2, SD_UP);
+		auto firstTest = performTest(context, executor, "First", VEC_SIZE, &expected);
+		auto secondTest = performTest(context, executor, "Second", VEC_SIZE, &expected);
 
-		requireSorted(arr, SD_UP);
+		firstTest.get();
+		secondTest.get();
 		
+		std::cout << "Checking asynchronous sort..." << std::endl;
 
+		{
+			myfcl::Queue queue{context};
 
-	#ifdef PRINT_SORTED
-		for(int i = 0; i < VEC_SIZE; i++){
-			std::cout << "arr[" << i << "] = " << arr[i] << std::endl;
+			std::vector<int> first(VEC_SIZE), second(VEC_SIZE);
+
+			for(auto&& i: first)
+				i = rand();
+
+			auto up = bitonic_sort_async(context, queue, first, SD_UP);
+
+			for(auto&& i: second) // prepared while the first sort runs
+				i = rand();
+
+			auto down = bitonic_sort_async(context, queue, second, SD_DOWN);
+
+			requireSorted(up.get(), SD_UP);
+			requireSorted(down.get(), SD_DOWN);
 		}
-	#endif
+
+		std::cout << "Checking sort split between CPU NUMA nodes..." << std::endl;
+
+		std::unique_ptr<myfcl::Context> numa;
+
+		try{
+			numa = std::make_unique<myfcl::Context>(myfcl::bestDevice(CL_DEVICE_TYPE_CPU), myfcl::PARTITION_BY_NUMA);
+		}
+		catch(myfcl::Exception const& e){
+			std::cout << "CPU device can't be split by NUMA nodes, skipped: " << e.what() << std::endl;
+		}
+
+		if(numa){
+			std::vector<int> shared(VEC_SIZE + 12345);
+			for(auto&& i: shared)
+				i = rand();
+
+			partitioned_sort(*numa, shared, SD_DOWN);
+			requireSorted(shared, SD_DOWN);
+
+			std::cout << "Sorted on " << numa->getNumOfDevices() << " partitions" << std::endl;
+		}
+
+		std::cout << "Checking metrics of a bitonic sort..." << std::endl;
+
+		{
+			std::vector<int> small(1 << 10);
+			for(auto&& i: small)
+				i = rand();
+
+			myfcl::metrics().reset();
+
+			bitonic_sort(context, small, SD_UP);
+
+			myfcl::MetricsSnapshot sort = myfcl::metrics().reset();
+
+			// log2(N) * (log2(N) + 1) / 2 stages, one launch each, and a single round trip of data
+
+			if(sort.kernel_launches["sortUp"] != 55 || sort.launches != 55)
+				throw(std::logic_error{"Unexpected number of bitonic sort launches"});
+
+			if(sort.bytes_to_device != small.size() * sizeof(int) || sort.bytes_to_host != small.size() * sizeof(int))
+				throw(std::logic_error{"Unexpected bitonic sort traffic"});
+
+			std::cout << sort.text();
+		}
+
+		std::cout << "Checking sort of a mapped dataset..." << std::endl;
+
+		{
+			std::string path = "bitonic_input.myds";
+
+			std::vector<int> data(VEC_SIZE);
+			myfcl::hostRandomRange(data.data(), data.size(), 0, RAND_MAX, 2025);
+
+			myfcl::saveDataset(path, data);
+
+			{
+				myfcl::Dataset input{path};
+				myfcl::Buffer<int> buf = input.buffer<int>(context);
+				myfcl::Queue queue{context};
+
+				// no Write: the device reads the mapped pages, Read makes results visible there
+
+				bitonic_sort(context, queue, buf, SD_DOWN);
+
+				queue.add(myfcl::Read{buf});
+				queue.execute();
+
+				myfcl::Validation check = myfcl::hostSorted(input.data<int>(), input.x(), true);
+
+				if(!check.passed)
+					throw(std::logic_error{"Mapped dataset is not sorted properly"});
+			}
+
+			std::remove(path.c_str());
+		}
+
+		std::cout << "Checking radix sort..." << std::endl;
+
+		performRadixTest<cl_int>(context, VEC_SIZE + 17, SD_UP);
+		performRadixTest<cl_uint>(context, VEC_SIZE, SD_DOWN);
+		performRadixTest<cl_long>(context, VEC_SIZE - 5, SD_DOWN);
+		performRadixTest<cl_ulong>(context, VEC_SIZE, SD_UP);
+
+		std::vector<int> small(1024);
+		for(auto&& i: small)
+			i = rand();
+
+		if(choose_sort_algorithm<int>(small.size()) != SA_BITONIC)
+			throw(std::logic_error{"Small int arrays are expected to be sorted by bitonic sort"});
+
+		sort_array(context, small, SD_DOWN);
+		requireSorted(small, SD_DOWN);
+
+		std::cout << "Checking segmented sort..." << std::endl;
+
+		performSegmentedTest(context, 20000, 100);
+		performSegmentedTest(context, 500, SEGMENT_MAX_SIZE);
+
+		std::cout << "Checking top-k selection..." << std::endl;
+
+		performTopKTest(context, VEC_SIZE, 100, SD_UP);
+		performTopKTest(context, VEC_SIZE + 1000, 1000, SD_DOWN);
+		performTopKTest(context, 10, 16, SD_DOWN);
+		performTopKTest(context, 1500, 1000, SD_UP, true);
+		performTopKTest(context, 1500, 1000, SD_DOWN, true);
+
+		std::cout << "Checking merge of sorted arrays..." << std::endl;
+
+		performMergeTest<int>(context, VEC_SIZE, VEC_SIZE / 3, SD_UP);
+		performMergeTest<float>(context, 1000, VEC_SIZE, SD_DOWN);
+		performMergeTest<int>(context, 0, 5, SD_DOWN);
+		performSortedIndexTest(context, 10, VEC_SIZE / 8);
 
 	}
 	catch(myfcl::Exception e){
@@ -39,4 +39,133 @@ __kernel void sortUp(__global int* arr, int i, int j){
 
 __kernel void sortDown(__global int* arr, int i, int j){
 	sort(arr, i, j, false);
-}
\ No newline at end of file
+}
+
+// Segmented sort: every work-group sorts one segment in local memory
+
+#define SEGMENT_MAX_SIZE 2048
+
+void local_bitonic_stage(__local int* keys, __local int* vals, __local uchar* pads, uint n, uint size, bool up){
+	// One stage of bitonic sort: merges every pair of sorted halves of size-long blocks
+	// n must be 2^k, whole group participates, vals may be NULL
+	// pads may be NULL, otherwise elements flagged in it lose ties with equal keys and move with them
+
+	uint lid = get_local_id(0);
+	uint lsize = get_local_size(0);
+
+	for(uint stride = size >> 1; stride > 0; stride >>= 1){
+		for(uint t = lid; t < n / 2; t += lsize){
+			uint in_group = t & (stride - 1);
+			uint id1 = 2 * t - in_group;
+			uint id2;
+
+			if(stride == size >> 1) // first step of stage compares mirrored elements, same as sort() above
+				id2 = id1 - 2 * in_group + size - 1;
+			else
+				id2 = id1 + stride;
+
+			bool cmp = keys[id1] > keys[id2];
+
+			if(!up) cmp = !cmp;
+
+			if(pads && keys[id1] == keys[id2])
+				cmp = pads[id1] && !pads[id2];
+
+			if(cmp){
+				int temp = keys[id1];
+				keys[id1] = keys[id2];
+				keys[id2] = temp;
+
+				if(vals){
+					temp = vals[id1];
+					vals[id1] = vals[id2];
+					vals[id2] = temp;
+				}
+
+				if(pads){
+					uchar pad = pads[id1];
+					pads[id1] = pads[id2];
+					pads[id2] = pad;
+				}
+			}
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+}
+
+void local_bitonic_sort(__local int* keys, __local int* vals, __local uchar* pads, uint n, bool up){
+	for(uint size = 2; size <= n; size <<= 1)
+		local_bitonic_stage(keys, vals, pads, n, size, up);
+}
+
+__kernel void segmented_sort(__global int* arr, __global const int* offsets, int up){
+	__local int buf[SEGMENT_MAX_SIZE];
+
+	uint lid = get_local_id(0);
+	uint lsize = get_local_size(0);
+	uint segment = get_group_id(0);
+
+	uint begin = offsets[segment];
+	uint len = offsets[segment + 1] - begin;
+
+	uint n = 1;
+	while(n < len) n <<= 1;
+
+	// padding goes to the tail of the sorted segment and is dropped
+
+	int pad = up ? INT_MAX : INT_MIN;
+
+	for(uint i = lid; i < n; i += lsize)
+		buf[i] = i < len ? arr[begin + i] : pad;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	local_bitonic_sort(buf, 0, 0, n, up);
+
+	for(uint i = lid; i < len; i += lsize)
+		arr[begin + i] = buf[i];
+}
+
+
+
+// Top-k selection: every work-group takes 2K inputs and keeps the best K of them,
+// so each launch halves the data until K elements are left
+
+#define TOPK_MAX_SIZE 2048 // 2K
+
+__kernel void topk_reduce(
+	__global const int* keys_in, __global const int* vals_in, uint n,
+	__global int* keys_out, __global int* vals_out, uint K, int up, int sorted_runs){
+	__local int keys[TOPK_MAX_SIZE];
+	__local int vals[TOPK_MAX_SIZE];
+	__local uchar pads[TOPK_MAX_SIZE];
+
+	uint lid = get_local_id(0);
+	uint lsize = get_local_size(0);
+	uint begin = get_group_id(0) * 2 * K;
+
+	// padding is worse than any key and loses ties with INT_MAX/INT_MIN keys, so every output
+	// run holds its valid elements first and n of a later launch counts valid elements only
+
+	int pad = up ? INT_MAX : INT_MIN;
+
+	for(uint i = lid; i < 2 * K; i += lsize){
+		bool valid = begin + i < n;
+		keys[i] = valid ? keys_in[begin + i] : pad;
+		vals[i] = valid && vals_in ? vals_in[begin + i] : -1;
+		pads[i] = !valid;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// inputs of later launches are pairs of sorted runs, only the last stage is needed to merge them
+
+	if(sorted_runs)
+		local_bitonic_stage(keys, vals_in ? vals : 0, pads, 2 * K, 2 * K, up);
+	else
+		local_bitonic_sort(keys, vals_in ? vals : 0, pads, 2 * K, up);
+
+	for(uint i = lid; i < K; i += lsize){
+		keys_out[get_group_id(0) * K + i] = keys[i];
+		if(vals_out)
+			vals_out[get_group_id(0) * K + i] = vals[i];
+	}
+}
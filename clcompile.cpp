@@ -0,0 +1,106 @@
+#include "MyFrameCL.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+
+/*
+	clcompile.cpp
+
+	Ahead-of-time compilation of embedded programs for the context device:
+	stores device binaries where Context::getProgram looks for them and
+	measures program creation time from source, device binary and SPIR-V
+
+	Usage: clcompile.o [platform name], the best device of all platforms by default
+
+*/
+
+#ifndef MYFCL_HAS_EMBEDDED_SOURCES
+#error "clcompile needs kernels.hpp, run make kernels.hpp"
+#endif
+
+template<typename F>
+double measure_ms(F&& f){
+	auto start = std::chrono::steady_clock::now();
+	f();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv){
+
+	try{
+		// programs create their contexts on the best device, so binaries are made for it unless a platform is named
+
+		auto own_context = argc > 1 ? std::make_unique<myfcl::Context>(argv[1]) : std::make_unique<myfcl::Context>();
+		myfcl::Context const& context = *own_context;
+
+		std::filesystem::create_directories(MYFCL_BINARY_DIR);
+
+		struct Timing{
+			const char* name;
+			double source, binary, il;
+		};
+
+		std::vector<Timing> timings;
+
+		for(auto const& src: myfcl::embedded_sources){
+			Timing t{src.name, 0, 0, -1};
+			std::unique_ptr<myfcl::Program> built;
+
+			t.source = measure_ms([&]{
+				built = std::make_unique<myfcl::Program>(context, src);
+			});
+
+			std::string binary = built->binary(); // not part of the build time
+
+			std::string path = context.binaryPath(src.name);
+			std::ofstream{path, std::ios::binary}.write(binary.data(), binary.size());
+
+			std::cout << "Stored " << path << std::endl;
+
+			t.binary = measure_ms([&]{
+				myfcl::Program prog{context, src.name, binary, myfcl::PF_BINARY};
+			});
+
+			std::string il;
+
+			if(myfcl::readSpirv(src.name, il)){
+				try{
+					t.il = measure_ms([&]{
+						myfcl::Program prog{context, src.name, il, myfcl::PF_IL};
+					});
+				}
+				catch(myfcl::Exception e){
+					std::cout << "SPIR-V is not supported: " << e.what() << std::endl;
+				}
+			}
+
+			timings.push_back(t);
+		}
+
+		// variants built with options (-D sizes, shapes) are not stored here and come from source at run time
+
+		std::cout << std::endl << "Program creation time, ms, default build options only (binary and SPIR-V cover no other variants):" << std::endl;
+		std::cout << std::setw(24) << std::left << "program" << std::setw(12) << "source" << std::setw(12) << "binary" << "SPIR-V" << std::endl;
+
+		double total_source = 0, total_binary = 0;
+
+		for(auto const& t: timings){
+			std::cout << std::setw(24) << t.name << std::setw(12) << t.source << std::setw(12) << t.binary;
+			if(t.il >= 0)
+				std::cout << t.il;
+			else
+				std::cout << "-";
+			std::cout << std::endl;
+
+			total_source += t.source;
+			total_binary += t.binary;
+		}
+
+		std::cout << std::setw(24) << "total" << std::setw(12) << total_source << std::setw(12) << total_binary << std::endl;
+	}
+	catch(myfcl::Exception e){
+		std::cerr << "ERROR: " << e.what() << " (myfcl::Exception)" << std::endl;
+		return -1;
+	}
+}
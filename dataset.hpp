@@ -0,0 +1,254 @@
+#pragma once
+
+#include "MyFrameCL.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+	dataset.hpp
+
+	Binary container for arrays and matrices: a header (dtype, shape, strides, checksum)
+	followed by raw elements at a HOST_ALIGNMENT offset. Dataset maps the file, and buffers
+	are created over the mapped pages with CL_MEM_USE_HOST_PTR, so inputs reach the device
+	without parsing or staging copies. Elements are stored in host byte order.
+
+*/
+
+namespace myfcl{
+
+enum DatasetType: uint32_t{
+	DT_INT32 = 1,
+	DT_FLOAT32 = 2,
+	DT_FLOAT64 = 3
+};
+
+template<typename T>
+struct dataset_type{
+};
+
+template<>
+struct dataset_type<cl_int>{
+	static constexpr DatasetType value = DT_INT32;
+};
+
+template<>
+struct dataset_type<float>{
+	static constexpr DatasetType value = DT_FLOAT32;
+};
+
+template<>
+struct dataset_type<double>{
+	static constexpr DatasetType value = DT_FLOAT64;
+};
+
+inline size_t datasetElemSize(uint32_t dtype){ // 0 for unknown types
+	switch(dtype){
+	case DT_INT32:
+		return sizeof(cl_int);
+	case DT_FLOAT32:
+		return sizeof(float);
+	case DT_FLOAT64:
+		return sizeof(double);
+	}
+	return 0;
+}
+
+struct DatasetHeader{
+	char magic[8];        // "MYFCLDS"
+	uint32_t version;
+	uint32_t dtype;       // DatasetType
+	uint32_t rank;        // 1 - array, 2 - matrix
+	uint32_t elem_size;   // bytes
+	uint64_t shape[2];    // rows, columns; an array is a single row
+	uint64_t strides[2];  // elements between rows, between columns
+	uint64_t data_offset; // bytes from file start, multiple of HOST_ALIGNMENT
+	uint64_t data_size;   // bytes
+	uint64_t checksum;    // datasetChecksum of data
+};
+
+static_assert(std::is_trivially_copyable_v<DatasetHeader> && sizeof(DatasetHeader) <= HOST_ALIGNMENT);
+
+inline constexpr char DATASET_MAGIC[8] = "MYFCLDS";
+inline constexpr uint32_t DATASET_VERSION = 1;
+
+inline uint64_t datasetChecksum(const void* data, size_t size){
+
+	// FNV-1a over 64-bit words, the tail is zero-padded to a word
+
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t hash = 14695981039346656037ull;
+
+	size_t i = 0;
+
+	for(; i + 8 <= size; i += 8){
+		uint64_t word;
+		std::memcpy(&word, bytes + i, 8);
+		hash = (hash ^ word) * 1099511628211ull;
+	}
+
+	if(i < size){
+		uint64_t word = 0;
+		std::memcpy(&word, bytes + i, size - i);
+		hash = (hash ^ word) * 1099511628211ull;
+	}
+
+	return hash;
+}
+
+inline std::string systemError(std::string const& what){
+	std::stringstream ss;
+	ss << what << ": " << std::strerror(errno);
+	return ss.str();
+}
+
+template<typename T>
+void saveDataset(std::string const& path, T const* data, size_t x, size_t y, size_t ld){
+
+	// Writes y rows of ld elements (x of them in use) as a matrix dataset
+
+	if(ld < x)
+		throw(Exception{"Leading dimension is less than row length"});
+
+	DatasetHeader header{};
+
+	std::memcpy(header.magic, DATASET_MAGIC, sizeof(header.magic));
+	header.version = DATASET_VERSION;
+	header.dtype = dataset_type<T>::value;
+	header.rank = y == 1 ? 1 : 2;
+	header.elem_size = sizeof(T);
+	header.shape[0] = y;
+	header.shape[1] = x;
+	header.strides[0] = ld;
+	header.strides[1] = 1;
+	header.data_offset = HOST_ALIGNMENT;
+	header.data_size = ld * y * sizeof(T);
+	header.checksum = datasetChecksum(data, header.data_size);
+
+	std::ofstream file{path, std::ios::binary | std::ios::trunc};
+
+	std::vector<char> head(HOST_ALIGNMENT, 0);
+	std::memcpy(head.data(), &header, sizeof(header));
+
+	file.write(head.data(), head.size());
+	file.write(reinterpret_cast<const char*>(data), header.data_size);
+
+	if(!file)
+		throw(Exception{("Failed to write dataset " + path).c_str()});
+}
+
+template<typename T>
+void saveDataset(std::string const& path, std::vector<T> const& array){
+	saveDataset(path, array.data(), array.size(), 1, array.size());
+}
+
+class Dataset{
+
+	// Private mapping of a dataset file: pages are read in on first touch, writes
+	// (e.g. sorting in place) go to copy-on-write pages and never reach the file
+
+	DatasetHeader header_;
+	void* map_ = MAP_FAILED;
+	size_t map_size_ = 0;
+
+	void check(bool condition, const char* what, std::string const& path){
+		if(!condition){
+			if(map_ != MAP_FAILED)
+				munmap(map_, map_size_);
+			throw(Exception{("Dataset " + path + ": " + what).c_str()});
+		}
+	}
+
+public:
+
+	explicit Dataset(std::string const& path, bool verify = true){
+		int fd = open(path.c_str(), O_RDONLY);
+
+		if(fd < 0)
+			throw(Exception{systemError("Failed to open " + path).c_str()});
+
+		struct stat st;
+
+		if(fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(DatasetHeader)){
+			map_size_ = st.st_size;
+			map_ = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		}
+
+		close(fd);
+
+		check(map_ != MAP_FAILED, "can't be mapped or is too small", path);
+
+		std::memcpy(&header_, map_, sizeof(header_));
+
+		check(std::memcmp(header_.magic, DATASET_MAGIC, sizeof(header_.magic)) == 0, "bad magic", path);
+		check(header_.version == DATASET_VERSION, "unsupported version", path);
+		check(datasetElemSize(header_.dtype) != 0, "unknown element type", path);
+		check(header_.elem_size == datasetElemSize(header_.dtype), "element size doesn't match type", path);
+		check(header_.rank == 1 || header_.rank == 2, "unsupported rank", path);
+		check(header_.rank == 2 || header_.shape[0] == 1, "array with several rows", path);
+		check(header_.strides[1] == 1 && header_.strides[0] >= header_.shape[1], "unsupported strides", path);
+		check(header_.data_offset % HOST_ALIGNMENT == 0, "misaligned data", path);
+		check(header_.data_size == header_.shape[0] * header_.strides[0] * header_.elem_size, "data size doesn't match shape", path);
+		check(header_.data_offset + header_.data_size <= map_size_, "truncated", path);
+		check(!verify || datasetChecksum(data(), header_.data_size) == header_.checksum, "checksum mismatch", path);
+
+		madvise(map_, map_size_, MADV_SEQUENTIAL);
+	}
+
+	Dataset(Dataset const&) = delete;
+
+	Dataset& operator=(Dataset const&) = delete;
+
+	~Dataset(){
+		munmap(map_, map_size_);
+	}
+
+	DatasetHeader const& header() const{
+		return header_;
+	}
+
+	DatasetType dtype() const{
+		return static_cast<DatasetType>(header_.dtype);
+	}
+
+	size_t x() const{
+		return header_.shape[1];
+	}
+
+	size_t y() const{
+		return header_.shape[0];
+	}
+
+	size_t ld() const{
+		return header_.strides[0];
+	}
+
+	size_t count() const{ // elements including row padding
+		return header_.data_size / header_.elem_size;
+	}
+
+	void* data(){
+		return static_cast<char*>(map_) + header_.data_offset;
+	}
+
+	template<typename T>
+	T* data(){
+		if(dataset_type<T>::value != header_.dtype || sizeof(T) != header_.elem_size)
+			throw(Exception{"Dataset element type mismatch"});
+
+		return static_cast<T*>(data());
+	}
+
+	template<typename T>
+	Buffer<T> buffer(Context const& ct, cl_mem_flags flags = CL_MEM_READ_WRITE){
+
+		// Device buffer over the mapped pages, the dataset must outlive it
+
+		T* begin = data<T>();
+		return Buffer<T>{ct, begin, begin + count(), flags | CL_MEM_USE_HOST_PTR};
+	}
+};
+
+}
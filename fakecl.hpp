@@ -0,0 +1,619 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <string>
+#include <array>
+#include <algorithm>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <sstream>
+#include <cstring>
+
+/*
+	fakecl.hpp
+
+	Recording OpenCL backend, compiled in place of an OpenCL runtime when MYFCL_FAKE_CL
+	is defined (make fake). It implements the part of the API MyFrameCL.hpp uses on host:
+	one in-order device, every command completes when it's enqueued, kernels run host
+	implementations registered with fake::registerKernel (unregistered ones are recorded
+	and skipped). Every call is logged with the bytes it passes, so API budgets of the
+	framework can be checked on machines without a device.
+
+*/
+
+struct _cl_platform_id{
+};
+
+struct _cl_device_id{
+};
+
+struct _cl_context{
+};
+
+struct _cl_command_queue{
+};
+
+struct _cl_mem{
+	std::vector<char> own;
+	char* data;
+	size_t size;
+};
+
+struct _cl_program{
+	std::string text; // source or binary, binaries of the fake device are the text they were built from
+};
+
+struct _cl_kernel{
+	std::string name;
+	std::vector<std::vector<char>> args;
+};
+
+struct _cl_event{
+	std::atomic<int> refs{1};
+};
+
+namespace myfcl::fake{
+
+struct ApiCall{
+	const char* name;
+	size_t bytes;       // moved by transfers and fills, passed to clSetKernelArg, program text
+	bool blocking;      // host waited for the device: blocking transfers and clFinish
+	std::string detail; // kernel name, build options
+};
+
+class Recorder{
+
+	mutable std::mutex mutex_;
+	std::vector<ApiCall> calls_;
+
+	template<typename P>
+	size_t countIf(P const& pred) const{
+		std::lock_guard<std::mutex> lock{mutex_};
+		return std::count_if(calls_.begin(), calls_.end(), pred);
+	}
+
+public:
+
+	void record(const char* name, size_t bytes = 0, bool blocking = false, std::string detail = {}){
+		std::lock_guard<std::mutex> lock{mutex_};
+		calls_.push_back(ApiCall{name, bytes, blocking, std::move(detail)});
+	}
+
+	std::vector<ApiCall> calls() const{
+		std::lock_guard<std::mutex> lock{mutex_};
+		return calls_;
+	}
+
+	size_t count(std::string_view name) const{
+		return countIf([name](ApiCall const& call){ return name == call.name; });
+	}
+
+	size_t bytes(std::string_view name) const{
+		std::lock_guard<std::mutex> lock{mutex_};
+
+		size_t ret = 0;
+
+		for(auto const& call: calls_)
+			if(name == call.name)
+				ret += call.bytes;
+
+		return ret;
+	}
+
+	size_t launches(std::string_view kernel) const{
+		return countIf([kernel](ApiCall const& call){ return std::string_view{"clEnqueueNDRangeKernel"} == call.name && call.detail == kernel; });
+	}
+
+	size_t hostSyncs() const{
+		return countIf([](ApiCall const& call){ return call.blocking; });
+	}
+
+	void reset(){
+		std::lock_guard<std::mutex> lock{mutex_};
+		calls_.clear();
+	}
+
+	std::string text() const{
+
+		// Calls, bytes and host syncs per API function
+
+		std::map<std::string_view, std::array<size_t, 3>> summary;
+
+		{
+			std::lock_guard<std::mutex> lock{mutex_};
+
+			for(auto const& call: calls_){
+				auto& entry = summary[call.name];
+				entry[0]++;
+				entry[1] += call.bytes;
+				entry[2] += call.blocking;
+			}
+		}
+
+		std::stringstream ss;
+
+		for(auto const& [name, entry]: summary)
+			ss << name << ": " << entry[0] << " calls, " << entry[1] << " bytes, " << entry[2] << " host syncs" << std::endl;
+
+		return ss.str();
+	}
+};
+
+inline Recorder& recorder(){
+	static Recorder instance;
+	return instance;
+}
+
+class Launch{
+
+	// Arguments and sizes of an emulated kernel launch
+
+	_cl_kernel const& kernel_;
+	cl_uint dims_;
+	size_t const* global_;
+	size_t const* local_;
+
+public:
+
+	Launch(_cl_kernel const& kernel, cl_uint dims, size_t const* global, size_t const* local):
+		kernel_(kernel), dims_(dims), global_(global), local_(local){
+	}
+
+	template<typename T>
+	T* buffer(cl_uint index) const{
+		return reinterpret_cast<T*>(scalar<cl_mem>(index)->data);
+	}
+
+	template<typename T>
+	T scalar(cl_uint index) const{
+		T value{};
+		std::memcpy(&value, kernel_.args.at(index).data(), std::min(sizeof(T), kernel_.args.at(index).size()));
+		return value;
+	}
+
+	cl_uint dimensions() const{
+		return dims_;
+	}
+
+	size_t global(cl_uint dim) const{
+		return dim < dims_ ? global_[dim] : 1;
+	}
+
+	size_t local(cl_uint dim) const{ // 0 if left to implementation
+		return local_ ? (dim < dims_ ? local_[dim] : 1) : 0;
+	}
+};
+
+using KernelImpl = std::function<void(Launch const&)>;
+
+inline std::mutex kernels_mutex;
+inline std::map<std::string, KernelImpl> kernels;
+
+inline void registerKernel(std::string name, KernelImpl impl){
+	std::lock_guard<std::mutex> lock{kernels_mutex};
+	kernels[std::move(name)] = std::move(impl);
+}
+
+inline _cl_platform_id platform;
+inline _cl_device_id device;
+
+inline cl_int info(const void* value, size_t size, size_t param_size, void* param_value, size_t* param_size_ret){
+	if(param_size_ret)
+		*param_size_ret = size;
+
+	if(param_value){
+		if(param_size < size)
+			return CL_INVALID_VALUE;
+
+		std::memcpy(param_value, value, size);
+	}
+
+	return CL_SUCCESS;
+}
+
+inline cl_int info(const char* value, size_t param_size, void* param_value, size_t* param_size_ret){
+	return info(value, std::strlen(value) + 1, param_size, param_value, param_size_ret);
+}
+
+template<typename T>
+cl_int info(T value, size_t param_size, void* param_value, size_t* param_size_ret){
+	return info(&value, sizeof(T), param_size, param_value, param_size_ret);
+}
+
+inline void setError(cl_int* errcode_ret, cl_int err){
+	if(errcode_ret)
+		*errcode_ret = err;
+}
+
+inline void newEvent(cl_event* event){
+	if(event)
+		*event = new _cl_event;
+}
+
+}
+
+// API subset used by the framework, C linkage as declared in CL/cl.h
+
+extern "C"{
+
+inline cl_int clGetPlatformIDs(cl_uint num_entries, cl_platform_id* platforms, cl_uint* num_platforms){
+	myfcl::fake::recorder().record("clGetPlatformIDs");
+
+	if(num_platforms)
+		*num_platforms = 1;
+
+	if(platforms && num_entries)
+		platforms[0] = &myfcl::fake::platform;
+
+	return CL_SUCCESS;
+}
+
+inline cl_int clGetPlatformInfo(cl_platform_id, cl_platform_info param, size_t param_size, void* param_value, size_t* param_size_ret){
+	using namespace myfcl::fake;
+
+	switch(param){
+	case CL_PLATFORM_NAME:
+		return info("myfcl fake", param_size, param_value, param_size_ret);
+	case CL_PLATFORM_VENDOR:
+		return info("myfcl", param_size, param_value, param_size_ret);
+	case CL_PLATFORM_VERSION:
+		return info("OpenCL 1.2 recording backend", param_size, param_value, param_size_ret);
+	case CL_PLATFORM_PROFILE:
+		return info("FULL_PROFILE", param_size, param_value, param_size_ret);
+	case CL_PLATFORM_EXTENSIONS:
+		return info("", param_size, param_value, param_size_ret);
+	}
+
+	return CL_INVALID_VALUE;
+}
+
+inline cl_int clGetDeviceIDs(cl_platform_id, cl_device_type type, cl_uint num_entries, cl_device_id* devices, cl_uint* num_devices){
+	myfcl::fake::recorder().record("clGetDeviceIDs");
+
+	if(!(type & (CL_DEVICE_TYPE_CPU | CL_DEVICE_TYPE_DEFAULT)))
+		return CL_DEVICE_NOT_FOUND;
+
+	if(num_devices)
+		*num_devices = 1;
+
+	if(devices && num_entries)
+		devices[0] = &myfcl::fake::device;
+
+	return CL_SUCCESS;
+}
+
+inline cl_int clGetDeviceInfo(cl_device_id, cl_device_info param, size_t param_size, void* param_value, size_t* param_size_ret){
+	using namespace myfcl::fake;
+
+	size_t item_sizes[3] = {1024, 1024, 1024};
+
+	switch(param){
+	case CL_DEVICE_NAME:
+		return info("myfcl recording device", param_size, param_value, param_size_ret);
+	case CL_DEVICE_VENDOR:
+		return info("myfcl", param_size, param_value, param_size_ret);
+	case CL_DEVICE_VERSION:
+		return info("OpenCL 1.2 recording backend", param_size, param_value, param_size_ret);
+	case CL_DEVICE_EXTENSIONS:
+		return info("cl_khr_fp64", param_size, param_value, param_size_ret);
+	case CL_DEVICE_TYPE:
+		return info(cl_device_type{CL_DEVICE_TYPE_CPU}, param_size, param_value, param_size_ret);
+	case CL_DEVICE_PLATFORM:
+		return info(cl_platform_id{&platform}, param_size, param_value, param_size_ret);
+	case CL_DEVICE_MAX_COMPUTE_UNITS:
+		return info(cl_uint{1}, param_size, param_value, param_size_ret);
+	case CL_DEVICE_MAX_CLOCK_FREQUENCY:
+		return info(cl_uint{1000}, param_size, param_value, param_size_ret);
+	case CL_DEVICE_MAX_WORK_GROUP_SIZE:
+		return info(size_t{1024}, param_size, param_value, param_size_ret);
+	case CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS:
+		return info(cl_uint{3}, param_size, param_value, param_size_ret);
+	case CL_DEVICE_MAX_WORK_ITEM_SIZES:
+		return info(item_sizes, sizeof(item_sizes), param_size, param_value, param_size_ret);
+	case CL_DEVICE_LOCAL_MEM_SIZE:
+		return info(cl_ulong{64} << 10, param_size, param_value, param_size_ret);
+	case CL_DEVICE_GLOBAL_MEM_SIZE:
+		return info(cl_ulong{4} << 30, param_size, param_value, param_size_ret);
+	case CL_DEVICE_MAX_MEM_ALLOC_SIZE:
+		return info(cl_ulong{1} << 30, param_size, param_value, param_size_ret);
+	case CL_DEVICE_MEM_BASE_ADDR_ALIGN:
+		return info(cl_uint{4096 * 8}, param_size, param_value, param_size_ret);
+	case CL_DEVICE_QUEUE_PROPERTIES:
+		return info(cl_command_queue_properties{0}, param_size, param_value, param_size_ret);
+	}
+
+	return CL_INVALID_VALUE;
+}
+
+inline cl_int clCreateSubDevices(cl_device_id, const cl_device_partition_property*, cl_uint, cl_device_id*, cl_uint*){
+	myfcl::fake::recorder().record("clCreateSubDevices");
+	return CL_INVALID_VALUE; // the fake device has a single compute unit
+}
+
+inline cl_int clReleaseDevice(cl_device_id){
+	return CL_SUCCESS;
+}
+
+inline cl_context clCreateContext(const cl_context_properties*, cl_uint, const cl_device_id*,
+	void (CL_CALLBACK*)(const char*, const void*, size_t, void*), void*, cl_int* errcode_ret){
+
+	myfcl::fake::recorder().record("clCreateContext");
+	myfcl::fake::setError(errcode_ret, CL_SUCCESS);
+	return new _cl_context;
+}
+
+inline cl_int clReleaseContext(cl_context context){
+	delete context;
+	return CL_SUCCESS;
+}
+
+inline cl_command_queue clCreateCommandQueue(cl_context, cl_device_id, cl_command_queue_properties, cl_int* errcode_ret){
+	myfcl::fake::recorder().record("clCreateCommandQueue");
+	myfcl::fake::setError(errcode_ret, CL_SUCCESS);
+	return new _cl_command_queue;
+}
+
+inline cl_int clReleaseCommandQueue(cl_command_queue queue){
+	delete queue;
+	return CL_SUCCESS;
+}
+
+inline cl_mem clCreateBuffer(cl_context, cl_mem_flags flags, size_t size, void* host_ptr, cl_int* errcode_ret){
+	myfcl::fake::recorder().record("clCreateBuffer", size);
+
+	if(size == 0 || (host_ptr != nullptr) != ((flags & (CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR)) != 0)){
+		myfcl::fake::setError(errcode_ret, size == 0 ? CL_INVALID_BUFFER_SIZE : CL_INVALID_HOST_PTR);
+		return nullptr;
+	}
+
+	cl_mem mem = new _cl_mem;
+	mem->size = size;
+
+	if(flags & CL_MEM_USE_HOST_PTR)
+		mem->data = static_cast<char*>(host_ptr);
+	else{
+		mem->own.resize(size);
+		mem->data = mem->own.data();
+
+		if(flags & CL_MEM_COPY_HOST_PTR)
+			std::memcpy(mem->data, host_ptr, size);
+	}
+
+	myfcl::fake::setError(errcode_ret, CL_SUCCESS);
+	return mem;
+}
+
+inline cl_int clReleaseMemObject(cl_mem mem){
+	delete mem;
+	return CL_SUCCESS;
+}
+
+inline cl_program clCreateProgramWithSource(cl_context, cl_uint count, const char** strings, const size_t* lengths, cl_int* errcode_ret){
+	cl_program program = new _cl_program;
+
+	for(cl_uint i = 0; i < count; i++)
+		program->text.append(strings[i], lengths && lengths[i] ? lengths[i] : std::strlen(strings[i]));
+
+	myfcl::fake::recorder().record("clCreateProgramWithSource", program->text.size());
+	myfcl::fake::setError(errcode_ret, CL_SUCCESS);
+	return program;
+}
+
+inline cl_program clCreateProgramWithBinary(cl_context, cl_uint num_devices, const cl_device_id*, const size_t* lengths,
+	const unsigned char** binaries, cl_int* binary_status, cl_int* errcode_ret){
+
+	cl_program program = new _cl_program;
+	program->text.assign(reinterpret_cast<const char*>(binaries[0]), lengths[0]);
+
+	for(cl_uint i = 0; binary_status && i < num_devices; i++)
+		binary_status[i] = CL_SUCCESS;
+
+	myfcl::fake::recorder().record("clCreateProgramWithBinary", program->text.size());
+	myfcl::fake::setError(errcode_ret, CL_SUCCESS);
+	return program;
+}
+
+#ifdef CL_VERSION_2_1
+inline cl_program clCreateProgramWithIL(cl_context, const void* il, size_t length, cl_int* errcode_ret){
+	cl_program program = new _cl_program;
+	program->text.assign(static_cast<const char*>(il), length);
+
+	myfcl::fake::recorder().record("clCreateProgramWithIL", length);
+	myfcl::fake::setError(errcode_ret, CL_SUCCESS);
+	return program;
+}
+#endif
+
+inline cl_int clReleaseProgram(cl_program program){
+	delete program;
+	return CL_SUCCESS;
+}
+
+inline cl_int clBuildProgram(cl_program program, cl_uint, const cl_device_id*, const char* options,
+	void (CL_CALLBACK*)(cl_program, void*), void*){
+
+	myfcl::fake::recorder().record("clBuildProgram", program->text.size(), false, options ? options : "");
+	return CL_SUCCESS;
+}
+
+inline cl_int clGetProgramInfo(cl_program program, cl_program_info param, size_t param_size, void* param_value, size_t* param_size_ret){
+	using namespace myfcl::fake;
+
+	switch(param){
+	case CL_PROGRAM_NUM_DEVICES:
+		return info(cl_uint{1}, param_size, param_value, param_size_ret);
+	case CL_PROGRAM_BINARY_SIZES:
+		return info(program->text.size(), param_size, param_value, param_size_ret);
+	case CL_PROGRAM_BINARIES:
+		if(param_size_ret)
+			*param_size_ret = sizeof(unsigned char*);
+
+		if(param_value)
+			std::memcpy(*static_cast<unsigned char**>(param_value), program->text.data(), program->text.size());
+
+		return CL_SUCCESS;
+	}
+
+	return CL_INVALID_VALUE;
+}
+
+inline cl_int clGetProgramBuildInfo(cl_program, cl_device_id, cl_program_build_info param, size_t param_size, void* param_value, size_t* param_size_ret){
+	if(param == CL_PROGRAM_BUILD_LOG)
+		return myfcl::fake::info("", param_size, param_value, param_size_ret);
+
+	return CL_INVALID_VALUE;
+}
+
+inline cl_kernel clCreateKernel(cl_program program, const char* kernel_name, cl_int* errcode_ret){
+	myfcl::fake::recorder().record("clCreateKernel", 0, false, kernel_name);
+
+	if(program->text.find(kernel_name) == std::string::npos){
+		myfcl::fake::setError(errcode_ret, CL_INVALID_KERNEL_NAME);
+		return nullptr;
+	}
+
+	myfcl::fake::setError(errcode_ret, CL_SUCCESS);
+	return new _cl_kernel{kernel_name, {}};
+}
+
+inline cl_int clGetKernelWorkGroupInfo(cl_kernel, cl_device_id, cl_kernel_work_group_info param, size_t param_size, void* param_value, size_t* param_size_ret){
+	if(param == CL_KERNEL_WORK_GROUP_SIZE)
+		return myfcl::fake::info(size_t{1024}, param_size, param_value, param_size_ret);
+
+	return CL_INVALID_VALUE;
+}
+
+inline cl_int clReleaseKernel(cl_kernel kernel){
+	delete kernel;
+	return CL_SUCCESS;
+}
+
+inline cl_int clSetKernelArg(cl_kernel kernel, cl_uint arg_index, size_t arg_size, const void* arg_value){
+	myfcl::fake::recorder().record("clSetKernelArg", arg_size, false, kernel->name);
+
+	if(kernel->args.size() <= arg_index)
+		kernel->args.resize(arg_index + 1);
+
+	// local memory arguments (no value) are kept as empty
+
+	const char* bytes = static_cast<const char*>(arg_value);
+	kernel->args[arg_index].assign(bytes, bytes ? bytes + arg_size : bytes);
+
+	return CL_SUCCESS;
+}
+
+inline cl_int clRetainEvent(cl_event event){
+	event->refs++;
+	return CL_SUCCESS;
+}
+
+inline cl_int clReleaseEvent(cl_event event){
+	if(--event->refs == 0)
+		delete event;
+	return CL_SUCCESS;
+}
+
+inline cl_int clSetEventCallback(cl_event event, cl_int, void (CL_CALLBACK* pfn_notify)(cl_event, cl_int, void*), void* user_data){
+	myfcl::fake::recorder().record("clSetEventCallback");
+
+	pfn_notify(event, CL_COMPLETE, user_data); // commands are complete once enqueued
+	return CL_SUCCESS;
+}
+
+inline cl_int clFlush(cl_command_queue){
+	myfcl::fake::recorder().record("clFlush");
+	return CL_SUCCESS;
+}
+
+inline cl_int clFinish(cl_command_queue){
+	myfcl::fake::recorder().record("clFinish", 0, true);
+	return CL_SUCCESS;
+}
+
+inline cl_int clEnqueueReadBuffer(cl_command_queue, cl_mem mem, cl_bool blocking, size_t offset, size_t size, void* ptr,
+	cl_uint, const cl_event*, cl_event* event){
+
+	myfcl::fake::recorder().record("clEnqueueReadBuffer", size, blocking);
+
+	if(offset + size > mem->size)
+		return CL_INVALID_VALUE;
+
+	std::memmove(ptr, mem->data + offset, size); // may be the same memory with CL_MEM_USE_HOST_PTR
+	myfcl::fake::newEvent(event);
+	return CL_SUCCESS;
+}
+
+inline cl_int clEnqueueWriteBuffer(cl_command_queue, cl_mem mem, cl_bool blocking, size_t offset, size_t size, const void* ptr,
+	cl_uint, const cl_event*, cl_event* event){
+
+	myfcl::fake::recorder().record("clEnqueueWriteBuffer", size, blocking);
+
+	if(offset + size > mem->size)
+		return CL_INVALID_VALUE;
+
+	std::memmove(mem->data + offset, ptr, size);
+	myfcl::fake::newEvent(event);
+	return CL_SUCCESS;
+}
+
+inline cl_int clEnqueueCopyBuffer(cl_command_queue, cl_mem src, cl_mem dst, size_t src_offset, size_t dst_offset, size_t size,
+	cl_uint, const cl_event*, cl_event* event){
+
+	myfcl::fake::recorder().record("clEnqueueCopyBuffer", size);
+
+	if(src_offset + size > src->size || dst_offset + size > dst->size)
+		return CL_INVALID_VALUE;
+
+	std::memmove(dst->data + dst_offset, src->data + src_offset, size);
+	myfcl::fake::newEvent(event);
+	return CL_SUCCESS;
+}
+
+inline cl_int clEnqueueFillBuffer(cl_command_queue, cl_mem mem, const void* pattern, size_t pattern_size, size_t offset, size_t size,
+	cl_uint, const cl_event*, cl_event* event){
+
+	myfcl::fake::recorder().record("clEnqueueFillBuffer", size);
+
+	if(offset + size > mem->size || size % pattern_size != 0)
+		return CL_INVALID_VALUE;
+
+	for(size_t i = offset; i < offset + size; i += pattern_size)
+		std::memcpy(mem->data + i, pattern, pattern_size);
+
+	myfcl::fake::newEvent(event);
+	return CL_SUCCESS;
+}
+
+inline cl_int clEnqueueNDRangeKernel(cl_command_queue, cl_kernel kernel, cl_uint work_dim, const size_t*, const size_t* global_work_size,
+	const size_t* local_work_size, cl_uint, const cl_event*, cl_event* event){
+
+	myfcl::fake::recorder().record("clEnqueueNDRangeKernel", 0, false, kernel->name);
+
+	myfcl::fake::KernelImpl impl;
+
+	{
+		std::lock_guard<std::mutex> lock{myfcl::fake::kernels_mutex};
+		auto found = myfcl::fake::kernels.find(kernel->name);
+
+		if(found != myfcl::fake::kernels.end())
+			impl = found->second;
+	}
+
+	if(impl)
+		impl(myfcl::fake::Launch{*kernel, work_dim, global_work_size, local_work_size});
+
+	myfcl::fake::newEvent(event);
+	return CL_SUCCESS;
+}
+
+inline cl_int clEnqueueMarkerWithWaitList(cl_command_queue, cl_uint, const cl_event*, cl_event* event){
+	myfcl::fake::recorder().record("clEnqueueMarkerWithWaitList");
+	myfcl::fake::newEvent(event);
+	return CL_SUCCESS;
+}
+
+}
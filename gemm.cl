@@ -0,0 +1,74 @@
+// General matrix multiplication C = alpha * op(A) * op(B) + beta * C
+//
+// op(X) is X or X^T (transA/transB), op(A) is M x K, op(B) is K x N, C is M x N.
+// Matrices are stored by rows, lda/ldb/ldc are distances between rows.
+// Work-item (get_global_id(0), get_global_id(1)) computes C[row = id1][col = id0],
+// K is walked in GEMM_TILE x GEMM_TILE tiles staged through local memory.
+//
+// A variant specialized on one shape is built with GEMM_M, GEMM_N, GEMM_K, GEMM_LDA,
+// GEMM_LDB, GEMM_LDC, GEMM_TRANS_A and GEMM_TRANS_B defined: matching arguments are
+// ignored and the compiler sees loop bounds, strides and transposes as constants.
+
+#define GEMM_TILE 16
+
+#ifdef GEMM_M
+#define GEMM_SHAPE(ARG, CONST) (CONST)
+#else
+#define GEMM_SHAPE(ARG, CONST) (ARG)
+#endif
+
+#define GEMM_KERNEL(T, SUFFIX) \
+\
+__kernel void gemm_##SUFFIX(int transA_arg, int transB_arg, int M_arg, int N_arg, int K_arg, T alpha, \
+	__global const T* A, int lda_arg, __global const T* B, int ldb_arg, T beta, __global T* C, int ldc_arg){ \
+	__local T tileA[GEMM_TILE][GEMM_TILE]; \
+	__local T tileB[GEMM_TILE][GEMM_TILE]; \
+\
+	const int M = GEMM_SHAPE(M_arg, GEMM_M); \
+	const int N = GEMM_SHAPE(N_arg, GEMM_N); \
+	const int K = GEMM_SHAPE(K_arg, GEMM_K); \
+	const int lda = GEMM_SHAPE(lda_arg, GEMM_LDA); \
+	const int ldb = GEMM_SHAPE(ldb_arg, GEMM_LDB); \
+	const int ldc = GEMM_SHAPE(ldc_arg, GEMM_LDC); \
+	const int transA = GEMM_SHAPE(transA_arg, GEMM_TRANS_A); \
+	const int transB = GEMM_SHAPE(transB_arg, GEMM_TRANS_B); \
+\
+	int col = get_global_id(0); \
+	int row = get_global_id(1); \
+	int lc = get_local_id(0); \
+	int lr = get_local_id(1); \
+\
+	T sum = 0; \
+\
+	for(int t = 0; t < K; t += GEMM_TILE){ \
+		int ka = t + lc; \
+		int kb = t + lr; \
+\
+		tileA[lr][lc] = row < M && ka < K ? (transA ? A[ka * lda + row] : A[row * lda + ka]) : 0; \
+		tileB[lr][lc] = kb < K && col < N ? (transB ? B[col * ldb + kb] : B[kb * ldb + col]) : 0; \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+\
+		for(int k = 0; k < GEMM_TILE; k++) \
+			sum += tileA[lr][k] * tileB[k][lc]; \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+	} \
+\
+	if(row < M && col < N){ \
+		/* C is not read when beta == 0, so it may hold garbage */ \
+		if(beta == 0) \
+			C[row * ldc + col] = alpha * sum; \
+		else \
+			C[row * ldc + col] = alpha * sum + beta * C[row * ldc + col]; \
+	} \
+}
+
+GEMM_KERNEL(int, int)
+
+GEMM_KERNEL(float, float)
+
+#ifdef cl_khr_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+
+GEMM_KERNEL(double, double)
+
+#endif
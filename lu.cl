@@ -0,0 +1,118 @@
+// LU factorization with partial pivoting: P * A = L * U
+//
+// Right-looking unblocked algorithm, host enqueues per column k:
+//	lu_pivot  - single work-group finds the pivot row, swaps it with row k and
+//	            scales column k below the diagonal (multipliers of L)
+//	lu_update - rank-1 update of the trailing (n - k - 1) x (n - k - 1) block
+// L (unit diagonal, not stored) and U share the matrix storage, piv[k] is the
+// row swapped with row k on step k. info gets k + 1 of the first zero pivot.
+//
+// lu_solve solves A * X = B for many right-hand sides at once, one work-item
+// per column of B (permutation, forward and back substitution).
+
+#define LU_GROUP_SIZE 256
+
+#define LU_KERNELS(T, SUFFIX) \
+\
+__kernel void lu_pivot_##SUFFIX(__global T* A, int n, int lda, int k, __global int* piv, __global int* info){ \
+	__local T best_val[LU_GROUP_SIZE]; \
+	__local int best_row[LU_GROUP_SIZE]; \
+\
+	int lid = get_local_id(0); \
+	int lsize = get_local_size(0); \
+\
+	T val = -1; \
+	int row = k; \
+\
+	for(int i = k + lid; i < n; i += lsize){ \
+		T cur = fabs(A[i * lda + k]); \
+		if(cur > val){ \
+			val = cur; \
+			row = i; \
+		} \
+	} \
+\
+	best_val[lid] = val; \
+	best_row[lid] = row; \
+	barrier(CLK_LOCAL_MEM_FENCE); \
+\
+	/* ties go to the upper row, as in LAPACK */ \
+	for(int offset = lsize / 2; offset > 0; offset >>= 1){ \
+		if(lid < offset){ \
+			T other = best_val[lid + offset]; \
+			if(other > best_val[lid] || (other == best_val[lid] && best_row[lid + offset] < best_row[lid])){ \
+				best_val[lid] = other; \
+				best_row[lid] = best_row[lid + offset]; \
+			} \
+		} \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+	} \
+\
+	int p = best_row[0]; \
+\
+	if(lid == 0) \
+		piv[k] = p; \
+\
+	if(best_val[0] == 0){ \
+		if(lid == 0 && *info == 0) \
+			*info = k + 1; \
+		return; \
+	} \
+\
+	T pivot = A[p * lda + k]; \
+	barrier(CLK_GLOBAL_MEM_FENCE); \
+\
+	if(p != k) \
+		for(int j = lid; j < n; j += lsize){ \
+			T temp = A[k * lda + j]; \
+			A[k * lda + j] = A[p * lda + j]; \
+			A[p * lda + j] = temp; \
+		} \
+	barrier(CLK_GLOBAL_MEM_FENCE); \
+\
+	for(int i = k + 1 + lid; i < n; i += lsize) \
+		A[i * lda + k] /= pivot; \
+} \
+\
+__kernel void lu_update_##SUFFIX(__global T* A, int lda, int k){ \
+	int j = k + 1 + get_global_id(0); \
+	int i = k + 1 + get_global_id(1); \
+\
+	A[i * lda + j] -= A[i * lda + k] * A[k * lda + j]; \
+} \
+\
+__kernel void lu_solve_##SUFFIX(__global const T* LU, int n, int lda, __global const int* piv, __global T* B, int ldb){ \
+	int r = get_global_id(0); \
+\
+	for(int k = 0; k < n; k++){ \
+		int p = piv[k]; \
+		if(p != k){ \
+			T temp = B[k * ldb + r]; \
+			B[k * ldb + r] = B[p * ldb + r]; \
+			B[p * ldb + r] = temp; \
+		} \
+	} \
+\
+	for(int i = 1; i < n; i++){ \
+		T sum = B[i * ldb + r]; \
+		for(int j = 0; j < i; j++) \
+			sum -= LU[i * lda + j] * B[j * ldb + r]; \
+		B[i * ldb + r] = sum; \
+	} \
+\
+	for(int i = n - 1; i >= 0; i--){ \
+		T sum = B[i * ldb + r]; \
+		for(int j = i + 1; j < n; j++) \
+			sum -= LU[i * lda + j] * B[j * ldb + r]; \
+		B[i * ldb + r] = sum / LU[i * lda + i]; \
+	} \
+}
+
+LU_KERNELS(float, float)
+
+#ifdef cl_khr_fp64 // float kernels stay usable on devices without double support
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+
+LU_KERNELS(double, double)
+
+#endif
@@ -1,48 +1,13 @@
 
-__kernel void matrix_multiply(
-    __global int *A, __global int *B, __global int *C, int AX, int BX) {
-  int row = get_global_id(0);
-  int col = get_global_id(1);
-  int sum = 0;
+__kernel void matrix_transpose( // A has Y rows of X elements lda apart, B gets X rows of Y ldb apart
+	__global int* A, __global int* B, int X, int Y, int lda, int ldb){
+	int col = get_global_id(0);
+	int row = get_global_id(1);
 
-  for (int k = 0; k < AX; k++)
-    sum += A[row * AX + k] * B[k * BX + col];
-
-  C[row * BX + col] = sum;
-}
-
-__kernel void matrix_multiply_float(
-    __global float *A, __global float *B, __global float *C, int AX, int BX) {
-  int row = get_global_id(0);
-  int col = get_global_id(1);
-  float sum = 0.0;
-
-  for (int k = 0; k < AX; k++)
-    sum += A[row * AX + k] * B[k * BX + col];
-
-  C[row * BX + col] = sum;
-}
-
-__kernel void matrix_multiply_double(
-    __global double *A, __global double *B, __global double *C, int AX, int BX) {
-  int row = get_global_id(0);
-  int col = get_global_id(1);
-  double sum = 0.0;
-
-  for (int k = 0; k < AX; k++)
-    sum += A[row * AX + k] * B[k * BX + col];
-
-  C[row * BX + col] = sum;
-}
-
-
-
-__kernel void matrix_transpose(
-	__global int* A, __global int* B, int X, int Y){
-	int row = get_global_id(0);
-	int col = get_global_id(1);
+	if(col >= X || row >= Y) // global size is rounded up to work-group size
+		return;
 
-	B[col * Y + row] = A[row * X + col];
+	B[col * ldb + row] = A[row * lda + col];
 }
 
 
@@ -55,15 +20,23 @@ __kernel void matrix_transpose(
 	
 	Please, ensure matrix has size less than 256 * 256
 
+	Building with -D MATRIX_SIZE=<n> bakes the size in, SIZE argument is ignored then
+
 */
 
 __kernel void matrix_simplify_column( // Expects Both A and B matrices be squared and same size
-	__global double* A, __global double* B, int SIZE, int COLUMN, __global int* err){
+	__global double* A, __global double* B, int SIZE_arg, int COLUMN, __global int* err){
 	
+#ifdef MATRIX_SIZE
+	const int SIZE = MATRIX_SIZE;
+#else
+	const int SIZE = SIZE_arg;
+#endif
+
 	int id = get_global_id(0);
 
 
-	if(id == 0 && A[COLUMN * SIZE + COLUMN] == 0){ // one of the cores will search for non-null unit of column
+	if(id == 0 && err[0] != -1 && A[COLUMN * SIZE + COLUMN] == 0){ // one of the cores will search for non-null unit of column, failure stays reported
 		int i;
 		for(i = COLUMN + 1; i < SIZE; i++)
 			if(A[i * SIZE + COLUMN] != 0)
@@ -1,6 +1,14 @@
 #include "MyFrameCL.hpp"
+#include "random.hpp"
+#include "validate.hpp"
+#include "dataset.hpp"
 #include <cstdlib>
 #include <ctime>
+#include <cmath>
+#include <algorithm>
+#include <type_traits>
+#include <map>
+#include <mutex>
 
 /* 
 	matrices.cpp 
@@ -13,24 +21,83 @@
 
 
 
+template<typename T>
+class MatrixView{
+
+	// Non-owning 2D window into row-major storage with leading dimension ld
+
+	T* data_;
+
+	size_t x_, y_, ld_; // x  -horisonal size; y - vertical size; ld - distance between rows
+
+public:
+
+	MatrixView(T* data, size_t x, size_t y, size_t ld): data_(data), x_(x), y_(y), ld_(ld){
+	}
+
+	template<typename U, typename = std::enable_if_t<std::is_same_v<T, U const>>>
+	MatrixView(MatrixView<U> const& view): MatrixView(view.data(), view.x(), view.y(), view.ld()){
+	}
+
+	size_t x() const{
+		return x_;
+	}
+
+	size_t y() const{
+		return y_;
+	}
+
+	size_t ld() const{
+		return ld_;
+	}
+
+	T* data() const{
+		return data_;
+	}
+
+	T* row(size_t y_index) const{
+		return data_ + y_index * ld_;
+	}
+
+	T& operator()(size_t y_index, size_t x_index) const{ // unchecked
+		return data_[y_index * ld_ + x_index];
+	}
+
+	MatrixView sub(size_t x0, size_t y0, size_t x, size_t y) const{
+		if(x0 + x > x_ || y0 + y > y_)
+			throw(std::out_of_range("Submatrix is out of matrix range"));
+
+		return MatrixView{data_ + y0 * ld_ + x0, x, y, ld_};
+	}
+};
+
+template<typename T>
+MatrixView<T> dataset_view(myfcl::Dataset& dataset){
+
+	// Host access to a mapped matrix dataset without copying it into a Matrix
+
+	return MatrixView<T>{dataset.data<T>(), dataset.x(), dataset.y(), dataset.ld()};
+}
+
 template<typename T>
 class Matrix{
 
 	// 2D matrix container adapter
+	// Rows are ld_ >= x_ elements apart, storage is aligned for device transfers
 
-	using container = std::vector<T>;
+	using container = myfcl::aligned_vector<T>;
 	
+	size_t x_, y_, ld_; // x  -horisonal size; y - vertical size; ld - distance between rows
+
 	container data_;
-	
-	size_t x_, y_; // x  -horisonal size; y - vertical size
 
 	class MatrixRowConst{
-		container::const_iterator row;
+		typename container::const_iterator row;
 		size_t x_;
 	public:
-		MatrixRowConst(container::const_iterator it, size_t x): row(it), x_(x){};
+		MatrixRowConst(typename container::const_iterator it, size_t x): row(it), x_(x){};
 		T const& operator[](size_t x_index) {
-			if(x_index > x_){
+			if(x_index >= x_){
 				std::stringstream ss;
 				ss << "Column index " << x_index << " is out of matrix column range(" << x_ << ")";
 				throw(std::out_of_range{ss.str()});
@@ -40,12 +107,12 @@ class Matrix{
 	};
 
 	class MatrixRow{
-		container::iterator row;
+		typename container::iterator row;
 		size_t x_;
 	public:
-		MatrixRow(container::iterator it, size_t x): row(it), x_(x){};
+		MatrixRow(typename container::iterator it, size_t x): row(it), x_(x){};
 		T& operator[](size_t x_index) {
-			if(x_index > x_){
+			if(x_index >= x_){
 				std::stringstream ss;
 				ss << "Column index " << x_index << " is out of matrix column range(" << x_ << ")";
 				throw(std::out_of_range{ss.str()});
@@ -54,12 +121,56 @@ class Matrix{
 		}
 	};
 
+	static size_t paddedLd(size_t x, size_t align){
+
+		// Smallest ld >= x giving rows aligned on align bytes
+
+		size_t elems = align % sizeof(T) == 0 ? align / sizeof(T) : 1;
+		return (x + elems - 1) / elems * elems;
+	}
+
 public:
 
-	Matrix(size_t x): x_(x), y_(x), data_(x * x){
+	Matrix(size_t x): x_(x), y_(x), ld_(x), data_(x * x){
+	}
+
+	Matrix(size_t x, size_t y): x_(x), y_(y), ld_(x), data_(x * y){
+	}
+
+	Matrix(size_t x, size_t y, size_t ld): x_(x), y_(y), ld_(ld), data_(ld * y){
+		if(ld < x)
+			throw(std::logic_error("Leading dimension is less than row length"));
 	}
 
-	Matrix(size_t x, size_t y): x_(x), y_(y), data_(x * y){
+	Matrix(size_t x, size_t y, myfcl::Context const& context): Matrix(x, y, paddedLd(x, context.baseAddrAlign())){
+
+		// Rows padded to device base address alignment
+
+	}
+
+	explicit Matrix(MatrixView<T const> view): Matrix(view.x(), view.y()){
+
+		// Dense copy of view
+
+		for(size_t j = 0; j < y_; j++)
+			std::copy(view.row(j), view.row(j) + x_, data_.begin() + j * ld_);
+	}
+
+	Matrix(myfcl::Buffer<T>&& buf, size_t x, size_t y, size_t ld): x_(x), y_(y), ld_(ld), data_(buf.releaseHostData()){
+
+		// Takes buffer's host storage over without copying
+
+		if(ld < x || data_.size() != ld * y)
+			throw(std::logic_error("Buffer size doesn't match matrix dimensions"));
+	}
+
+	myfcl::Buffer<T> toBuffer(myfcl::Context const& context, cl_mem_flags flags = CL_MEM_READ_WRITE) &&{
+
+		// Moves storage into a new buffer, matrix is left empty
+
+		x_ = y_ = ld_ = 0;
+
+		return myfcl::Buffer<T>{context, std::move(data_), flags};
 	}
 
 	size_t x() const{
@@ -70,24 +181,44 @@ public:
 		return y_;
 	}
 
+	size_t ld() const{
+		return ld_;
+	}
+
 	MatrixRowConst operator[](size_t y_index) const{
-		if(y_index > y_){
+		if(y_index >= y_){
 			std::stringstream ss;
 			ss << "Row index " << y_index << " is out of matrix row range(" << y_ << ")";
 			throw(std::out_of_range{ss.str()});
 		}
 		
-		return MatrixRowConst{data_.begin() + y_index * x_, x_}; 
+		return MatrixRowConst{data_.begin() + y_index * ld_, x_}; 
 	}
 
 	MatrixRow operator[](size_t y_index) {
-		if(y_index > y_){
+		if(y_index >= y_){
 			std::stringstream ss;
 			ss << "Row index " << y_index << " is out of matrix row range(" << y_ << ")";
 			throw(std::out_of_range{ss.str()});
 		}
 		
-		return MatrixRow{data_.begin() + y_index * x_, x_}; 
+		return MatrixRow{data_.begin() + y_index * ld_, x_}; 
+	}
+
+	T const& operator()(size_t y_index, size_t x_index) const{ // unchecked
+		return data_[y_index * ld_ + x_index];
+	}
+
+	T& operator()(size_t y_index, size_t x_index){ // unchecked
+		return data_[y_index * ld_ + x_index];
+	}
+
+	MatrixView<T const> view() const{
+		return MatrixView<T const>{data_.data(), x_, y_, ld_};
+	}
+
+	MatrixView<T> view(){
+		return MatrixView<T>{data_.data(), x_, y_, ld_};
 	}
 
 	void randomize(size_t range = 100){
@@ -96,6 +227,23 @@ public:
 			i = static_cast<T>(rand() % rint - rint / 2);
 	}
 
+	void randomize(myfcl::Context const& context, uint64_t seed, size_t range = 100){
+
+		// Same distribution generated on device, reproducible by seed (see random.hpp)
+
+		int rint = static_cast<int>(range);
+
+		myfcl::Buffer<cl_int> random{context, data_.size()};
+		myfcl::Queue queue{context};
+
+		myfcl::randomRange(context, queue, random, -rint / 2, rint - rint / 2, seed);
+
+		queue.add(myfcl::Read{random});
+		queue.execute();
+
+		std::transform(random.begin(), random.end(), data_.begin(), [](cl_int v){ return static_cast<T>(v); });
+	}
+
 	container const& data() const{
 		return data_;
 	}
@@ -111,20 +259,20 @@ public:
 
 
 	void swapRows(size_t row1, size_t row2){
-		if(row1 > y_ || row2 > y_)
+		if(row1 >= y_ || row2 >= y_)
 			throw(std::out_of_range("Matrix index out of range"));
 
 		if(row1 == row2)
 			return;
 
-		std::swap_ranges(data_.begin() + row1 * x_, data_.begin() + (row1 + 1) * x_, data_.begin() + row2 * x_);
+		std::swap_ranges(data_.begin() + row1 * ld_, data_.begin() + row1 * ld_ + x_, data_.begin() + row2 * ld_);
 	}
 
 
 	void print(){
 		for(int j = 0; j < y_; j++){
 			for(int i = 0; i < x_; i++)
-				std::cout << static_cast<int>(data_[j * x_ + i]) << " ";
+				std::cout << static_cast<int>(data_[j * ld_ + i]) << " ";
 			std::cout << std::endl;
 		}
 	}
@@ -155,9 +303,9 @@ void require_squared(Matrix<T> const& mat){
 }
 
 template<typename T>
-void require_E(Matrix<T> const& mat){
+void require_E(Matrix<T> const& mat, T tolerance = std::is_floating_point_v<T> ? static_cast<T>(0.01) : T{}){
 
-	// Ensures mat to have diag(1,1...1) form
+	// Ensures mat to have diag(1,1...1) form, within tolerance for floating point types
 
 	try{
 		require_squared(mat);
@@ -166,60 +314,64 @@ void require_E(Matrix<T> const& mat){
 		throw(std::logic_error{"Matrix required to be E, but is not squared"});
 	}
 
-	for(int i = 0; i < mat.x(); i++)
-		for(int j = 0; j < mat.y(); j++){
-			if((i == j && mat[j][i] != static_cast<T>(1)) || (i != j && mat[j][i] != static_cast<T>(0)))
-				throw(std::logic_error("Matrix required to be E"));
-		}
-}
+	myfcl::Validation check = myfcl::hostIdentity(mat.data().data(), mat.x(), mat.ld(), tolerance);
 
-template<typename T>
-bool flt_eps_equal(T f1, T f2){
-	return abs(f1 - f2) < static_cast<T>(0.01f);
-}
+	if(!check.passed){
+		size_t j = check.first_bad / mat.x(), i = check.first_bad % mat.x();
 
-template<>
-void require_E<float>(Matrix<float> const& mat){
-	try{
-		require_squared(mat);
-	}
-	catch(std::logic_error e){
-		throw(std::logic_error{"Matrix required to be E, but is not squared"});
+		std::stringstream ss;
+		ss << "Matrix required to be E ( mat[" << j << "][" << i << "] = " << mat(j, i) << " )";
+		
+		throw(std::logic_error(ss.str().c_str()));
 	}
-	for(int i = 0; i < mat.x(); i++)
-		for(int j = 0; j < mat.y(); j++){
-			if((i == j && !flt_eps_equal(mat[j][i],1.0f)) || (i != j && !flt_eps_equal(mat[j][i],0.0f)))
-				throw(std::logic_error("Matrix required to be E"));
-		}
 }
 
-template<>
-void require_E<double>(Matrix<double> const& mat){
-	try{
-		require_squared(mat);
-	}
-	catch(std::logic_error e){
-		throw(std::logic_error{"Matrix required to be E, but is not squared"});
-	}
-	for(int i = 0; i < mat.x(); i++)
-		for(int j = 0; j < mat.y(); j++){
-			if((i == j && !flt_eps_equal(mat[j][i],1.0)) || (i != j && !flt_eps_equal(mat[j][i],0.0))){
-				std::stringstream ss;
-				ss << "Matrix required to be E ( mat[" << j << "][" << i << "] = " << mat[j][i] << " )";
-				
-				throw(std::logic_error(ss.str().c_str()));
-			}
+
+enum {
+	SPECIALIZE_AFTER = 2,   // calls with the same shape before it gets its own variant
+	SPECIALIZE_SHAPES = 256 // shapes counted at most, rare ones are forgotten beyond that
+};
+
+myfcl::Program const& specialized_program(myfcl::Context const& context, const char* file, std::string const& shape){
+
+	//Returns file built with shape options if the shape is frequent, generic program otherwise
+
+	static std::map<std::string, size_t> shape_calls;
+	static std::mutex shape_calls_mutex; // jobs may run on many executor workers
+
+	size_t calls;
+
+	{
+		std::lock_guard<std::mutex> lock{shape_calls_mutex};
+
+		std::string key = std::string{file} + " " + shape;
+
+		if(shape_calls.size() >= SPECIALIZE_SHAPES && !shape_calls.count(key)){
+
+			// shapes seen once are dropped first, the whole map if that frees nothing
+
+			std::erase_if(shape_calls, [](auto const& entry){ return entry.second < SPECIALIZE_AFTER; });
+
+			if(shape_calls.size() >= SPECIALIZE_SHAPES)
+				shape_calls.clear();
 		}
-}
 
+		calls = ++shape_calls[key];
+	}
+
+	if(calls < SPECIALIZE_AFTER)
+		return context.getProgram(file);
+
+	return context.getProgram(file, shape);
+}
 
-Matrix<double> mat_reverse(Matrix<double> const& mat, myfcl::Context context){ 
+Matrix<double> mat_reverse(Matrix<double> const& mat, myfcl::Context const& context){ 
 
 	//performs matrix reverse by gaussian method using OCL context
 
 	require_squared(mat);
 
-	Matrix<double> temp = mat;
+	Matrix<double> temp{mat.view()}; // the only copy, dense as kernel expects
 
 	Matrix<double> ret = getEMatrix<double>(mat.x());
 
@@ -229,9 +381,9 @@ Matrix<double> mat_reverse(Matrix<double> const& mat, myfcl::Context context){
 
 	errBuf.begin()[0] = -2;
 
-	std::copy(mat.data().begin(), mat.data().end(), buf1.begin());
+	// variant with size baked in is built once the size repeats, generic kernel takes SIZE argument till then
 
-	myfcl::Program prog{context, "matrices.cl"};
+	myfcl::Program const& prog = specialized_program(context, "matrices.cl", myfcl::BuildOptions{}.define("MATRIX_SIZE", mat.x()).str());
 	myfcl::Kernel simpl{prog, "matrix_simplify_column"};
 
 	myfcl::Queue queue{context};
@@ -243,17 +395,25 @@ Matrix<double> mat_reverse(Matrix<double> const& mat, myfcl::Context context){
 	simpl.addArgument(2, &size);
 	simpl.addArgument(4, &errBuf.buffer());
 
-	queue.addTask(new myfcl::Write{buf1});
-	queue.addTask(new myfcl::Write{buf2});
-	queue.addTask(new myfcl::Write{errBuf});
+	queue.add(myfcl::Write{buf1});
+	queue.add(myfcl::Write{buf2});
+	queue.add(myfcl::Write{errBuf});
 
-	int work_group_size = mat.x() < 256 ? mat.x(): 256;
+	// kernel is correct within a single work-group only, so it takes as much as the kernel allows on the device
 
-	for(int i = 0; i < mat.x(); i++){
-		simpl.addArgument(3, &i);
-		queue.addTask(new myfcl::Execute{simpl, {work_group_size}, {mat.x()}});
-		queue.addTask(new myfcl::Read{errBuf});
-		queue.execute();
+	size_t work_group_size = std::min(mat.x(), simpl.workGroupSize(context.getDevice()));
+
+	// column step is recorded once and replayed for every column, i is read at replay
+
+	int i = 0;
+
+	myfcl::CommandList step;
+	step.bind(simpl, 3, &i);
+	step.record(myfcl::Execute{simpl, {work_group_size}, {mat.x()}});
+	step.record(myfcl::Read{errBuf});
+
+	for(i = 0; i < mat.x(); i++){
+		step.replay(queue);
 
 		if(errBuf.begin()[0] == -1)  
 
@@ -262,7 +422,7 @@ Matrix<double> mat_reverse(Matrix<double> const& mat, myfcl::Context context){
 			throw(std::logic_error{"Matrix can't be reversed(det == 0)"});
 	}
 
-	queue.addTask(new myfcl::Read{buf2});
+	queue.add(myfcl::Read{buf2});
 	
 	queue.execute();
 
@@ -270,166 +430,1374 @@ Matrix<double> mat_reverse(Matrix<double> const& mat, myfcl::Context context){
 	return ret;
 }
 
+enum Transpose{TR_NONE, TR_TRANS};
+
 template<typename T>
-struct mat_mult_kernel{
+struct gemm_kernel{
 
 };
 
 template<>
-struct mat_mult_kernel<float>{
-	static constexpr const char* name = "matrix_multiply_float";
+struct gemm_kernel<int>{
+	static constexpr const char* name = "gemm_int";
 };
 
 template<>
-struct mat_mult_kernel<int>{
-	static constexpr const char* name = "matrix_multiply";
+struct gemm_kernel<float>{
+	static constexpr const char* name = "gemm_float";
 };
 
 template<>
-struct mat_mult_kernel<double>{
-	static constexpr const char* name = "matrix_multiply_double";
+struct gemm_kernel<double>{
+	static constexpr const char* name = "gemm_double";
 };
 
+size_t round_up(size_t size, size_t multiple){
+	return (size + multiple - 1) / multiple * multiple;
+}
+
+enum { GEMM_TILE = 16 };
 
 template<typename T>
-Matrix<T> mat_mult(Matrix<T>& mat1, Matrix<T>& mat2, myfcl::Context context){ 
+void set_gemm_arguments(myfcl::Kernel const& gemm, Transpose transA, Transpose transB, cl_int M, cl_int N, cl_int K,
+						T alpha, myfcl::Buffer<T>& A, cl_int lda, myfcl::Buffer<T>& B, cl_int ldb, T beta, myfcl::Buffer<T>& C, cl_int ldc){
+	cl_int tA = transA == TR_TRANS;
+	cl_int tB = transB == TR_TRANS;
+
+	gemm.addArgument(0, &tA);
+	gemm.addArgument(1, &tB);
+	gemm.addArgument(2, &M);
+	gemm.addArgument(3, &N);
+	gemm.addArgument(4, &K);
+	gemm.addArgument(5, &alpha);
+	gemm.addArgument(6, &A.buffer());
+	gemm.addArgument(7, &lda);
+	gemm.addArgument(8, &B.buffer());
+	gemm.addArgument(9, &ldb);
+	gemm.addArgument(10, &beta);
+	gemm.addArgument(11, &C.buffer());
+	gemm.addArgument(12, &ldc);
+}
 
-	//Perform multiplication of 2 matrices using OCL context
+myfcl::NDRange gemm_global(size_t M, size_t N){
+	return {round_up(N, GEMM_TILE), round_up(M, GEMM_TILE)};
+}
 
+template<typename T>
+void enqueue_gemm(myfcl::Program const& prog, myfcl::Queue& queue, Transpose transA, Transpose transB, cl_int M, cl_int N, cl_int K,
+				  T alpha, myfcl::Buffer<T>& A, cl_int lda, myfcl::Buffer<T>& B, cl_int ldb, T beta, myfcl::Buffer<T>& C, cl_int ldc){
 
-	srand(time(NULL));
-	Matrix<T> ret{mat1.x(), mat2.y()};
+	//Enqueues C = alpha * op(A) * op(B) + beta * C on device buffers, nothing is read back
 
-	myfcl::Buffer<T> buf1{context, &mat1.data()};
-	myfcl::Buffer<T> buf2{context, &mat2.data()};
-	myfcl::Buffer<T> buf3{context, &ret.data()};
-	
-	myfcl::Program prog{context, "matrices.cl"};
-	myfcl::Kernel mult{prog, mat_mult_kernel<T>::name};
+	myfcl::Kernel gemm{prog, gemm_kernel<T>::name};
 
-	myfcl::Queue queue{context};
+	set_gemm_arguments(gemm, transA, transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
 
-	int AX = mat1.x();
-	int BX = mat2.x();
+	queue.add(myfcl::Execute{gemm, {GEMM_TILE, GEMM_TILE}, gemm_global(M, N)});
+	queue.execute();
+}
 
-	mult.addArgument(0, &buf1.buffer());
-	mult.addArgument(1, &buf2.buffer());
-	mult.addArgument(2, &buf3.buffer());
-	mult.addArgument(3, &AX);
-	mult.addArgument(4, &BX);
+template<typename T>
+void require_leading_dim(Matrix<T> const& mat, size_t ld){
 
-	queue.addTask(new myfcl::Write{buf1});
-	queue.addTask(new myfcl::Write{buf2});
-	
-	queue.addTask(new myfcl::Execute{mult, {{8}, {8}}, {{mat1.y()}, {mat1.x()}}});
+	// Ensures rows of mat placed ld elements apart fit its storage
 
-	queue.addTask(new myfcl::Read{buf3});
+	if(ld < mat.x() || (mat.y() > 0 && (mat.y() - 1) * ld + mat.x() > mat.data().size()))
+		throw(std::logic_error("Leading dimension doesn't match matrix storage"));
+}
 
-	queue.execute();
+myfcl::Program const& gemm_program(myfcl::Context const& context, Transpose transA, Transpose transB,
+								   cl_int M, cl_int N, cl_int K, cl_int lda, cl_int ldb, cl_int ldc){
 
-	return ret;
+	//Returns gemm.cl built for exactly this shape if the shape is frequent, generic program otherwise
+
+	myfcl::BuildOptions shape;
+	shape.define("GEMM_M", M).define("GEMM_N", N).define("GEMM_K", K)
+		 .define("GEMM_LDA", lda).define("GEMM_LDB", ldb).define("GEMM_LDC", ldc)
+		 .define("GEMM_TRANS_A", transA == TR_TRANS).define("GEMM_TRANS_B", transB == TR_TRANS);
+
+	return specialized_program(context, "gemm.cl", shape.str());
 }
 
-Matrix<int> mat_transpose(Matrix<int>& mat, myfcl::Context context){ 
-	
+template<typename T>
+void gemm_partitioned(Transpose transB, T alpha, Matrix<T>& A, size_t lda, Matrix<T>& B, size_t ldb,
+		  T beta, Matrix<T>& C, size_t ldc, myfcl::Context const& context){
 
-	//Perform matrix transpose using OCL context
-	
+	//C = alpha * A * op(B) + beta * C split by rows of A and C between context devices (partitions
+	//of a multi-socket CPU). Every partition gets its own copy of B and its rows of A and C, all
+	//written or filled from its own queue, so the operands are first touched on its memory node.
+	//Queues are the context's own, so repeated calls don't create them again
 
-	Matrix<int> ret{mat.y(), mat.x()};
+	size_t M = C.y(), N = C.x(), K = A.x();
 
-	myfcl::Buffer<int> buf1{context, &mat.data()};
-	myfcl::Buffer<int> buf2{context, &ret.data()};
-	
-	myfcl::Program prog{context, "matrices.cl"};
-	myfcl::Kernel transpose{prog, "matrix_transpose"};
+	context.withDeviceQueues([&](std::vector<std::shared_ptr<myfcl::Queue>>& queues){
+		std::vector<std::unique_ptr<myfcl::Buffer<T>>> bufs;
 
-	myfcl::Queue queue{context};
+		size_t parts = std::min<size_t>(queues.size(), M);
 
-	int X = mat.x();
-	int Y = mat.y();
+		for(size_t p = 0; p < parts; p++){
+			size_t first = p * M / parts, last = (p + 1) * M / parts;
+			myfcl::Queue& queue = *queues[p];
 
-	transpose.addArgument(0, &buf1.buffer());
-	transpose.addArgument(1, &buf2.buffer());
-	transpose.addArgument(2, &X);
-	transpose.addArgument(3, &Y);
+			auto bufA = std::make_unique<myfcl::Buffer<T>>(context, A.data().data() + first * lda, A.data().data() + (last - 1) * lda + K, CL_MEM_READ_ONLY);
+			auto bufB = std::make_unique<myfcl::Buffer<T>>(context, &B.data(), CL_MEM_READ_ONLY);
+			auto bufC = std::make_unique<myfcl::Buffer<T>>(context, C.data().data() + first * ldc, C.data().data() + (last - 1) * ldc + N);
 
-	queue.addTask(new myfcl::Write{buf1});
-	
-	queue.addTask(new myfcl::Execute{transpose, {{8}, {8}}, {{mat.x()}, {mat.y()}}});
+			queue.add(myfcl::WriteAsync{*bufA});
+			queue.add(myfcl::WriteAsync{*bufB});
 
-	queue.addTask(new myfcl::Read{buf2});
+			if(beta != static_cast<T>(0))
+				queue.add(myfcl::WriteAsync{*bufC});
+			else
+				queue.add(myfcl::Fill{*bufC});
 
-	queue.execute();
+			myfcl::Program const& prog = gemm_program(context, TR_NONE, transB, last - first, N, K, lda, ldb, ldc);
 
-	return ret;
+			enqueue_gemm<T>(prog, queue, TR_NONE, transB, last - first, N, K, alpha, *bufA, lda, *bufB, ldb, beta, *bufC, ldc);
+
+			queue.add(myfcl::ReadAsync{*bufC});
+			queue.execute();
+
+			bufs.push_back(std::move(bufA));
+			bufs.push_back(std::move(bufB));
+			bufs.push_back(std::move(bufC));
+		}
+
+		// queues stay alive, so buffers are kept until their commands complete
+
+		for(auto& queue: queues){
+			cl_int ret = myfcl::waitQueue(queue->queue());
+			if(ret != CL_SUCCESS)
+				throw(myfcl::Exception{"clFinish", ret, __LINE__, __FILE__});
+		}
+	});
 }
 
 template<typename T>
-void require_transposed(Matrix<T>& mat1, Matrix<T>& mat2){ 
+void gemm(Transpose transA, Transpose transB, T alpha, Matrix<T>& A, size_t lda, Matrix<T>& B, size_t ldb,
+		  T beta, Matrix<T>& C, size_t ldc, myfcl::Context const& context, myfcl::Queue* queue = nullptr){
 
-	
-	//Throws exception if mat1 and mat2 are not related as transposed form of each other
-	
+	//Performs C = alpha * op(A) * op(B) + beta * C using OCL context, op(X) is X or X^T
+	//Sizes are taken from C (M x N) and A (K), C is updated in place
+	//Everything goes through the given queue if there is one (e.g. of an executor worker)
 
-	if(mat1.x() != mat2.y() || mat1.y() != mat2.x())
-		throw(std::logic_error{"ERROR: Matrices sizes are incompatible"});
+	size_t M = C.y(), N = C.x();
+	size_t K = transA == TR_NONE ? A.x() : A.y();
+
+	if((transA == TR_NONE ? A.y() : A.x()) != M || (transB == TR_NONE ? B.y() : B.x()) != K || (transB == TR_NONE ? B.x() : B.y()) != N)
+		throw(std::logic_error("Matrices sizes are incompatible"));
+
+	require_leading_dim(A, lda);
+	require_leading_dim(B, ldb);
+	require_leading_dim(C, ldc);
+
+	if(M == 0 || N == 0)
+		return;
+
+	if(!queue && context.partitioned() && transA == TR_NONE){
+		gemm_partitioned(transB, alpha, A, lda, B, ldb, beta, C, ldc, context);
+		return;
+	}
+
+	myfcl::Buffer<T> bufA{context, &A.data(), CL_MEM_READ_ONLY};
+	myfcl::Buffer<T> bufB{context, &B.data(), CL_MEM_READ_ONLY};
+	myfcl::Buffer<T> bufC{context, &C.data()};
+
+	myfcl::Program const& prog = gemm_program(context, transA, transB, M, N, K, lda, ldb, ldc);
+
+	if(queue){
+
+		// worker queue of the caller is in-order, everything goes through it
+
+		queue->add(myfcl::Write{bufA});
+		queue->add(myfcl::Write{bufB});
+
+		if(beta != static_cast<T>(0))
+			queue->add(myfcl::Write{bufC});
+
+		enqueue_gemm<T>(prog, *queue, transA, transB, M, N, K, alpha, bufA, lda, bufB, ldb, beta, bufC, ldc);
+
+		queue->add(myfcl::Read{bufC});
+		queue->execute();
+
+		return;
+	}
+
+	// uploads don't depend on each other, so the context scheduler overlaps them on its queues,
+	// which are kept between calls; the launch waits for the uploads only
+
+	myfcl::Kernel gemm{prog, gemm_kernel<T>::name};
+
+	set_gemm_arguments(gemm, transA, transB, M, N, K, alpha, bufA, lda, bufB, ldb, beta, bufC, ldc);
 
-	for(int i = 0; i < mat1.x(); i++)
-		for(int j = 0; j < mat1.y(); j++)
-			if(mat1[j][i] != mat2[i][j])
-				throw(std::logic_error{"ERROR: Matrices are not transposed properly"});
+	context.withScheduler([&](myfcl::Scheduler& scheduler){
+		scheduler.write(bufA);
+		scheduler.write(bufB);
+
+		if(beta != static_cast<T>(0))
+			scheduler.write(bufC);
+
+		scheduler.launch(gemm, {GEMM_TILE, GEMM_TILE}, gemm_global(M, N), {bufA.buffer(), bufB.buffer()}, {bufC.buffer()});
+		scheduler.read(bufC);
+	});
 }
 
-//const int TRANSPOSE_TEST_SIZE = 1024;
-//const int REVERSE_TEST_SIZE = 128; // max stable size is ~ 128 
+template<typename T>
+Matrix<T> mat_mult(Matrix<T>& mat1, Matrix<T>& mat2, myfcl::Context const& context, myfcl::Queue* queue = nullptr){ 
 
+	//Perform multiplication of 2 matrices using OCL context
 
-int main(int argc, char** argv){
-	int TRANSPOSE_TEST_SIZE = 1024, REVERSE_TEST_SIZE = 128;
+	Matrix<T> ret{mat2.x(), mat1.y()};
 
-	for(int i = 0; i < argc; i++){
-		if(i == 1){
-			TRANSPOSE_TEST_SIZE = atoi(argv[i]);
-		}
+	gemm(TR_NONE, TR_NONE, static_cast<T>(1), mat1, mat1.ld(), mat2, mat2.ld(), static_cast<T>(0), ret, ret.ld(), context, queue);
 
-		if(i == 2){
-			REVERSE_TEST_SIZE = atoi(argv[i]);
+	return ret;
+}
+
+template<typename T>
+void ref_gemm(Transpose transA, Transpose transB, T alpha, Matrix<T> const& A, Matrix<T> const& B, T beta, Matrix<T>& C){
+
+	//Host version of gemm for checking, leading dimensions are taken from matrices
+
+	size_t K = transA == TR_NONE ? A.x() : A.y();
+
+	for(size_t i = 0; i < C.y(); i++)
+		for(size_t j = 0; j < C.x(); j++){
+			T sum = 0;
+			for(size_t k = 0; k < K; k++)
+				sum += (transA == TR_NONE ? A(i, k) : A(k, i)) * (transB == TR_NONE ? B(k, j) : B(j, k));
+			C(i, j) = alpha * sum + beta * C(i, j);
 		}
+}
 
-	}
+template<typename T>
+struct lu_kernel{
 
+};
 
-	bool err_catched = false;
+template<>
+struct lu_kernel<float>{
+	static constexpr const char* pivot = "lu_pivot_float";
+	static constexpr const char* update = "lu_update_float";
+	static constexpr const char* solve = "lu_solve_float";
+};
 
-	try{
+template<>
+struct lu_kernel<double>{
+	static constexpr const char* pivot = "lu_pivot_double";
+	static constexpr const char* update = "lu_update_double";
+	static constexpr const char* solve = "lu_solve_double";
+};
 
-		myfcl::Context context{"NVIDIA"};
+enum { LU_GROUP_SIZE = 256 };
 
-		std::cout << ">Checking matrix transpose" << std::endl;
-		
-		Matrix<int> mat{TRANSPOSE_TEST_SIZE};
+template<typename T>
+class LUFactor{
 
-		mat.randomize(10);
+	// LU factorization with partial pivoting P * A = L * U, kept on device
+	// Factorize once, then solve A * X = B for any number of new B cheaply
 
-		Matrix<int> transpose = mat_transpose(mat, context);
+	myfcl::Context const& context_;
+	cl_int n_;
 
-		require_transposed(mat, transpose);
+	myfcl::Buffer<T> lu_;
+	myfcl::Buffer<cl_int> piv_;
 
-		std::cout << "Test completed successfully" << std::endl << std::endl;
+	myfcl::Program const& prog_;
+	myfcl::Queue queue_;
 
+public:
+	LUFactor(Matrix<T> const& mat, myfcl::Context const& context): context_(context), n_(mat.x()),
+		lu_{context, mat.x() * mat.x()}, piv_{context, mat.x()}, prog_(context.getProgram("lu.cl")), queue_{context}{
 
-		std::cout << ">Checking matrix reverse and multiplication" << std::endl;
+		require_squared(mat);
 
-		Matrix<double> matRef{REVERSE_TEST_SIZE};
-		matRef.randomize(100);
+		for(size_t j = 0; j < mat.y(); j++) // factors are stored densely, lda == n
+			std::copy(mat.view().row(j), mat.view().row(j) + n_, lu_.begin() + j * n_);
 
-		
-		Matrix<double> matRev = mat_reverse(matRef, context);
+		myfcl::Buffer<cl_int> info{context, 1};
+		info[0] = 0;
 
-		Matrix<double> probably_E = mat_mult(matRef, matRev, context);
+		myfcl::Kernel pivot{prog_, lu_kernel<T>::pivot};
+		myfcl::Kernel update{prog_, lu_kernel<T>::update};
 
-		require_E<double>(probably_E);
+		pivot.addArgument(0, &lu_.buffer());
+		pivot.addArgument(1, &n_);
+		pivot.addArgument(2, &n_);
+		pivot.addArgument(4, &piv_.buffer());
+		pivot.addArgument(5, &info.buffer());
+
+		update.addArgument(0, &lu_.buffer());
+		update.addArgument(1, &n_);
+
+		queue_.add(myfcl::Write{lu_});
+		queue_.add(myfcl::Write{info});
+		queue_.execute();
+
+		// pivot search reduces by halves, so its group is the largest power of two the kernel allows on the device
+
+		size_t group = LU_GROUP_SIZE;
+		while(group > pivot.workGroupSize(context.getDevice()))
+			group >>= 1;
+
+		// all columns are enqueued without host round-trips, singularity is checked once at the end
+
+		for(cl_int k = 0; k < n_; k++){
+			pivot.addArgument(3, &k);
+			queue_.add(myfcl::Execute{pivot, {group}, {group}});
+			queue_.execute();
+
+			size_t rest = n_ - k - 1;
+
+			if(rest == 0)
+				break;
+
+			update.addArgument(2, &k);
+			queue_.add(myfcl::Execute{update, {}, {rest, rest}});
+			queue_.execute();
+		}
+
+		queue_.add(myfcl::Read{info});
+		queue_.execute();
+
+		if(info[0] != 0)
+			throw(std::logic_error{"Matrix can't be factorized(det == 0)"});
+	}
+
+	LUFactor(LUFactor const& another) = delete;
+
+	LUFactor const& operator=(LUFactor const& another) = delete;
+
+	size_t size() const{
+		return n_;
+	}
+
+	void solve(Matrix<T>& B){
+
+		// Replaces B (n x nrhs) with X such that A * X = B, every column is solved by its own work-item
+
+		if(B.y() != static_cast<size_t>(n_))
+			throw(std::logic_error("Right-hand side doesn't match factorized matrix"));
+
+		if(B.x() == 0)
+			return;
+
+		myfcl::Buffer<T> bufB{context_, &B.data()};
+		myfcl::Kernel solve{prog_, lu_kernel<T>::solve};
+
+		cl_int ldb = B.ld();
+
+		solve.addArgument(0, &lu_.buffer());
+		solve.addArgument(1, &n_);
+		solve.addArgument(2, &n_);
+		solve.addArgument(3, &piv_.buffer());
+		solve.addArgument(4, &bufB.buffer());
+		solve.addArgument(5, &ldb);
+
+		queue_.add(myfcl::Write{bufB});
+		queue_.add(myfcl::Execute{solve, {}, {B.x()}});
+		queue_.add(myfcl::Read{bufB});
+		queue_.execute();
+	}
+
+	Matrix<T> inverse(){
+		Matrix<T> ret = getEMatrix<T>(n_);
+		solve(ret);
+		return ret;
+	}
+
+	Matrix<T> factors(){
+
+		// L below diagonal (unit diagonal is implied) and U on and above it
+
+		Matrix<T> ret{static_cast<size_t>(n_)};
+
+		queue_.add(myfcl::Read{lu_});
+		queue_.execute();
+
+		std::copy(lu_.begin(), lu_.end(), ret.data().begin());
+
+		return ret;
+	}
+};
+
+template<typename T>
+Matrix<T> mat_solve(Matrix<T> const& A, Matrix<T> const& B, myfcl::Context const& context){
+
+	//Solves A * X = B using LU factorization in OCL context, cheaper and more stable than mat_reverse + mat_mult
+
+	Matrix<T> X = B;
+	LUFactor<T>{A, context}.solve(X);
+	return X;
+}
+
+template<typename T>
+T max_residual(Matrix<T> const& A, Matrix<T> const& X, Matrix<T> const& B){
+
+	//Returns max |A * X - B| computed on host
+
+	T ret = 0;
+
+	for(size_t i = 0; i < B.y(); i++)
+		for(size_t r = 0; r < B.x(); r++){
+			T sum = -B(i, r);
+			for(size_t k = 0; k < A.x(); k++)
+				sum += A(i, k) * X(k, r);
+			ret = std::max(ret, std::abs(sum));
+		}
+
+	return ret;
+}
+
+template<typename To, typename From>
+Matrix<To> mat_convert(Matrix<From> const& mat){
+
+	//Returns copy of mat with elements converted to To
+
+	Matrix<To> ret{mat.x(), mat.y(), mat.ld()};
+	std::transform(mat.data().begin(), mat.data().end(), ret.data().begin(), [](From v){ return static_cast<To>(v); });
+	return ret;
+}
+
+struct RefineReport{
+	size_t iterations;
+	double residual; // |B - A * X| / (|A| * |X| + |B|) in max norms
+};
+
+double refine_residual(Matrix<double> const& A, Matrix<double> const& X, Matrix<double> const& B, Matrix<double>& R){
+
+	//Computes R = B - A * X in double on host and returns its normwise relative size
+
+	double normA = 0, normX = 0, normB = 0, normR = 0;
+
+	for(size_t i = 0; i < A.y(); i++){
+		double row = 0;
+		for(size_t k = 0; k < A.x(); k++)
+			row += std::abs(A(i, k));
+		normA = std::max(normA, row);
+	}
+
+	for(size_t i = 0; i < B.y(); i++){
+		double rowX = 0, rowB = 0, rowR = 0;
+
+		for(size_t r = 0; r < B.x(); r++){
+			double sum = B(i, r);
+			for(size_t k = 0; k < A.x(); k++)
+				sum -= A(i, k) * X(k, r);
+			R(i, r) = sum;
+
+			rowX += std::abs(X(i, r));
+			rowB += std::abs(B(i, r));
+			rowR += std::abs(sum);
+		}
+
+		normX = std::max(normX, rowX);
+		normB = std::max(normB, rowB);
+		normR = std::max(normR, rowR);
+	}
+
+	double scale = normA * normX + normB;
+
+	return scale == 0 ? 0 : normR / scale;
+}
+
+Matrix<double> mat_solve_refined(Matrix<double> const& A, Matrix<double> const& B, myfcl::Context const& context,
+								 RefineReport* report = nullptr, double tolerance = 1e-12, size_t max_iterations = 30){
+
+	//Solves A * X = B with float LU factorization on device and iterative refinement in double on host
+	//Device never needs double support
+
+	require_squared(A);
+
+	if(B.y() != A.y())
+		throw(std::logic_error("Right-hand side doesn't match matrix"));
+
+	LUFactor<float> lu{mat_convert<float>(A), context};
+
+	Matrix<float> correction = mat_convert<float>(B);
+	lu.solve(correction);
+
+	Matrix<double> X = mat_convert<double>(correction);
+	Matrix<double> R{B.x(), B.y(), B.ld()}; // same layout as X and correction
+
+	size_t iterations = 0;
+	double residual = refine_residual(A, X, B, R);
+
+	while(residual > tolerance){
+		if(iterations == max_iterations)
+			throw(std::logic_error{"Iterative refinement did not converge (matrix is too ill-conditioned for float)"});
+
+		std::transform(R.data().begin(), R.data().end(), correction.data().begin(), [](double v){ return static_cast<float>(v); });
+		lu.solve(correction);
+
+		for(size_t i = 0; i < X.data().size(); i++)
+			X.data()[i] += correction.data()[i];
+
+		iterations++;
+		residual = refine_residual(A, X, B, R);
+	}
+
+	if(report)
+		*report = RefineReport{iterations, residual};
+
+	return X;
+}
+
+Matrix<double> mat_reverse_refined(Matrix<double> const& mat, myfcl::Context const& context, RefineReport* report = nullptr){ 
+
+	//Performs matrix reverse as mixed precision solve of A * X = E
+
+	return mat_solve_refined(mat, getEMatrix<double>(mat.x()), context, report);
+}
+
+template<typename T>
+class CSRMatrix{
+
+	// Compressed sparse row matrix
+	// Row i has values_[k] in columns col_idx_[k] for k in [row_ptr_[i], row_ptr_[i + 1])
+
+	std::vector<cl_int> row_ptr_;
+	std::vector<cl_int> col_idx_;
+	std::vector<T> values_;
+
+	size_t x_, y_; // x  -horisonal size; y - vertical size
+
+public:
+
+	CSRMatrix(Matrix<T> const& mat): row_ptr_(mat.y() + 1), x_(mat.x()), y_(mat.y()){
+
+		// Keeps only non-zero elements of dense matrix
+
+		row_ptr_[0] = 0;
+
+		for(size_t j = 0; j < y_; j++){
+			for(size_t i = 0; i < x_; i++){
+				T val = mat(j, i);
+				if(val != static_cast<T>(0)){
+					col_idx_.push_back(i);
+					values_.push_back(val);
+				}
+			}
+			row_ptr_[j + 1] = values_.size();
+		}
+	}
+
+	CSRMatrix(size_t x, size_t y, std::vector<cl_int> row_ptr, std::vector<cl_int> col_idx, std::vector<T> values):
+		row_ptr_(std::move(row_ptr)), col_idx_(std::move(col_idx)), values_(std::move(values)), x_(x), y_(y){
+
+		if(row_ptr_.size() != y_ + 1 || col_idx_.size() != values_.size() || static_cast<size_t>(row_ptr_.back()) != values_.size())
+			throw(std::logic_error("Inconsistent CSR matrix arrays"));
+	}
+
+	size_t x() const{
+		return x_;
+	}
+
+	size_t y() const{
+		return y_;
+	}
+
+	size_t nnz() const{
+		return values_.size();
+	}
+
+	double meanRowLength() const{
+		return y_ == 0 ? 0 : static_cast<double>(nnz()) / y_;
+	}
+
+	std::vector<cl_int>& row_ptr(){
+		return row_ptr_;
+	}
+
+	std::vector<cl_int>& col_idx(){
+		return col_idx_;
+	}
+
+	std::vector<T>& values(){
+		return values_;
+	}
+
+	Matrix<T> toDense() const{
+		Matrix<T> ret{x_, y_};
+		ret.setNull();
+
+		for(size_t j = 0; j < y_; j++)
+			for(cl_int k = row_ptr_[j]; k < row_ptr_[j + 1]; k++)
+				ret(j, col_idx_[k]) = values_[k];
+
+		return ret;
+	}
+};
+
+template<typename T>
+struct sparse_kernel{
+
+};
+
+template<>
+struct sparse_kernel<float>{
+	static constexpr const char* spmv_scalar = "spmv_scalar_float";
+	static constexpr const char* spmv_vector = "spmv_vector_float";
+	static constexpr const char* spmm_scalar = "spmm_scalar_float";
+	static constexpr const char* spmm_vector = "spmm_vector_float";
+};
+
+template<>
+struct sparse_kernel<double>{
+	static constexpr const char* spmv_scalar = "spmv_scalar_double";
+	static constexpr const char* spmv_vector = "spmv_vector_double";
+	static constexpr const char* spmm_scalar = "spmm_scalar_double";
+	static constexpr const char* spmm_vector = "spmm_vector_double";
+};
+
+enum { SPMV_VECTOR_SIZE = 32, SPMM_GROUP_SIZE = 64 };
+
+constexpr double SPARSE_VECTOR_MIN_ROW = 16; // mean row length from which work-group per row pays off
+
+template<typename T, typename Alloc>
+std::vector<T> spmv(CSRMatrix<T>& mat, std::vector<T, Alloc>& vec, myfcl::Context const& context){
+
+	//Performs sparse matrix by vector multiplication using OCL context
+
+	if(vec.size() != mat.x())
+		throw(std::logic_error("Matrix and vector sizes are incompatible"));
+
+	std::vector<T> ret(mat.y(), static_cast<T>(0));
+
+	if(mat.nnz() == 0)
+		return ret;
+
+	myfcl::Buffer<cl_int> rowBuf{context, &mat.row_ptr(), CL_MEM_READ_ONLY};
+	myfcl::Buffer<cl_int> colBuf{context, &mat.col_idx(), CL_MEM_READ_ONLY};
+	myfcl::Buffer<T> valBuf{context, &mat.values(), CL_MEM_READ_ONLY};
+	myfcl::Buffer<T> vecBuf{context, &vec, CL_MEM_READ_ONLY};
+	myfcl::Buffer<T> retBuf{context, &ret, CL_MEM_WRITE_ONLY};
+
+	bool vector = mat.meanRowLength() >= SPARSE_VECTOR_MIN_ROW;
+
+	myfcl::Program const& prog = context.getProgram("sparse.cl");
+	myfcl::Kernel mult{prog, vector ? sparse_kernel<T>::spmv_vector : sparse_kernel<T>::spmv_scalar};
+
+	myfcl::Queue queue{context};
+
+	cl_int rows = mat.y();
+
+	mult.addArgument(0, &rows);
+	mult.addArgument(1, &rowBuf.buffer());
+	mult.addArgument(2, &colBuf.buffer());
+	mult.addArgument(3, &valBuf.buffer());
+	mult.addArgument(4, &vecBuf.buffer());
+	mult.addArgument(5, &retBuf.buffer());
+
+	queue.add(myfcl::Write{rowBuf});
+	queue.add(myfcl::Write{colBuf});
+	queue.add(myfcl::Write{valBuf});
+	queue.add(myfcl::Write{vecBuf});
+
+	if(vector)
+		queue.add(myfcl::Execute{mult, {SPMV_VECTOR_SIZE}, {mat.y() * SPMV_VECTOR_SIZE}});
+	else
+		queue.add(myfcl::Execute{mult, {}, {mat.y()}});
+
+	queue.add(myfcl::Read{retBuf});
+
+	queue.execute();
+
+	return ret;
+}
+
+template<typename T>
+Matrix<T> spmm(CSRMatrix<T>& mat1, Matrix<T>& mat2, myfcl::Context const& context){
+
+	//Performs sparse by dense matrix multiplication using OCL context
+
+	if(mat1.x() != mat2.y())
+		throw(std::logic_error("Matrices sizes are incompatible"));
+
+	Matrix<T> ret{mat2.x(), mat1.y()};
+	ret.setNull();
+
+	if(mat1.nnz() == 0 || ret.data().empty())
+		return ret;
+
+	myfcl::Buffer<cl_int> rowBuf{context, &mat1.row_ptr(), CL_MEM_READ_ONLY};
+	myfcl::Buffer<cl_int> colBuf{context, &mat1.col_idx(), CL_MEM_READ_ONLY};
+	myfcl::Buffer<T> valBuf{context, &mat1.values(), CL_MEM_READ_ONLY};
+	myfcl::Buffer<T> buf2{context, &mat2.data(), CL_MEM_READ_ONLY};
+	myfcl::Buffer<T> buf3{context, &ret.data(), CL_MEM_WRITE_ONLY};
+
+	bool vector = mat1.meanRowLength() >= SPARSE_VECTOR_MIN_ROW;
+
+	myfcl::Program const& prog = context.getProgram("sparse.cl");
+	myfcl::Kernel mult{prog, vector ? sparse_kernel<T>::spmm_vector : sparse_kernel<T>::spmm_scalar};
+
+	myfcl::Queue queue{context};
+
+	cl_int rows = mat1.y();
+	cl_int cols = mat2.x();
+	cl_int ldb = mat2.ld();
+	cl_int ldc = ret.ld();
+
+	mult.addArgument(0, &rows);
+	mult.addArgument(1, &cols);
+	mult.addArgument(2, &rowBuf.buffer());
+	mult.addArgument(3, &colBuf.buffer());
+	mult.addArgument(4, &valBuf.buffer());
+	mult.addArgument(5, &buf2.buffer());
+	mult.addArgument(6, &ldb);
+	mult.addArgument(7, &buf3.buffer());
+	mult.addArgument(8, &ldc);
+
+	queue.add(myfcl::Write{rowBuf});
+	queue.add(myfcl::Write{colBuf});
+	queue.add(myfcl::Write{valBuf});
+	queue.add(myfcl::Write{buf2});
+
+	size_t global_x = (mat2.x() + SPMM_GROUP_SIZE - 1) / SPMM_GROUP_SIZE * SPMM_GROUP_SIZE;
+
+	if(vector)
+		queue.add(myfcl::Execute{mult, {SPMM_GROUP_SIZE, 1}, {global_x, mat1.y()}});
+	else
+		queue.add(myfcl::Execute{mult, {}, {global_x, mat1.y()}});
+
+	queue.add(myfcl::Read{buf3});
+
+	queue.execute();
+
+	return ret;
+}
+
+template<typename T>
+Matrix<T> getSparseMatrix(size_t x, size_t y, double density){
+
+	//Creates matrix with approximately density share of non-null elements
+
+	Matrix<T> ret{x, y};
+	ret.setNull();
+
+	for(auto&& i: ret.data())
+		if(rand() < density * RAND_MAX)
+			i = static_cast<T>(rand() % 19 - 9);
+
+	return ret;
+}
+
+Matrix<int> mat_transpose(Matrix<int>& mat, myfcl::Context const& context){ 
+	
+
+	//Perform matrix transpose using OCL context, rows of mat may be padded
+	
+
+	Matrix<int> ret{mat.y(), mat.x()};
+
+	myfcl::Buffer<int> buf1{context, &mat.data()};
+	myfcl::Buffer<int> buf2{context, &ret.data()};
+	
+	myfcl::Program const& prog = context.getProgram("matrices.cl");
+	myfcl::Kernel transpose{prog, "matrix_transpose"};
+
+	myfcl::Queue queue{context};
+
+	int X = mat.x();
+	int Y = mat.y();
+	int LDA = mat.ld();
+	int LDB = ret.ld();
+
+	transpose.addArgument(0, &buf1.buffer());
+	transpose.addArgument(1, &buf2.buffer());
+	transpose.addArgument(2, &X);
+	transpose.addArgument(3, &Y);
+	transpose.addArgument(4, &LDA);
+	transpose.addArgument(5, &LDB);
+
+	queue.add(myfcl::Write{buf1});
+	
+	queue.add(myfcl::Execute{transpose, {{8}, {8}}, {{round_up(mat.x(), 8)}, {round_up(mat.y(), 8)}}});
+
+	queue.add(myfcl::Read{buf2});
+
+	queue.execute();
+
+	return ret;
+}
+
+template<typename T>
+void require_transposed(Matrix<T> const& mat1, Matrix<T> const& mat2){ 
+
+	
+	//Throws exception if mat1 and mat2 are not related as transposed form of each other
+	
+
+	if(mat1.x() != mat2.y() || mat1.y() != mat2.x())
+		throw(std::logic_error{"ERROR: Matrices sizes are incompatible"});
+
+	myfcl::Validation check = myfcl::hostTransposed(mat1.data().data(), mat1.x(), mat1.y(), mat1.ld(), mat2.data().data(), mat2.ld());
+
+	if(!check.passed){
+		std::stringstream ss;
+		ss << "ERROR: Matrices are not transposed properly (mat1[" << check.first_bad / mat1.x() << "][" << check.first_bad % mat1.x() << "])";
+		throw(std::logic_error{ss.str()});
+	}
+}
+
+// Asynchronous API: operations enqueue on a caller's in-order queue and return at once.
+// Results stay on device as DeviceMatrix, so chained operations never read back in between,
+// and only read() brings a matrix to host through a future resolved by an event callback.
+
+struct DeviceCheck{
+
+	// Device flag checked when a result depending on it is read, failure value means error
+
+	std::shared_ptr<myfcl::Buffer<int>> flag;
+	int failure;
+	const char* message;
+};
+
+template<typename T>
+class DeviceMatrix{
+
+	std::shared_ptr<myfcl::Buffer<T>> buf_;
+	size_t x_, y_, ld_;
+
+	std::vector<DeviceCheck> checks_; // of this matrix and everything it was computed from
+
+public:
+
+	DeviceMatrix(std::shared_ptr<myfcl::Buffer<T>> buf, size_t x, size_t y, size_t ld, std::vector<DeviceCheck> checks = {}):
+		buf_(std::move(buf)), x_(x), y_(y), ld_(ld), checks_(std::move(checks)){
+	}
+
+	DeviceMatrix(Matrix<T> const& mat, myfcl::Context const& context): x_(mat.x()), y_(mat.y()), ld_(mat.ld()){
+
+		// Device copy is made at buffer creation, so mat may change right after the call and
+		// no pending upload depends on host storage of a temporary DeviceMatrix
+
+		buf_ = std::make_shared<myfcl::Buffer<T>>(context, myfcl::aligned_vector<T>(mat.data()), CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR);
+	}
+
+	DeviceMatrix(std::shared_ptr<myfcl::Dataset> dataset, myfcl::Context const& context): x_(dataset->x()), y_(dataset->y()), ld_(dataset->ld()){
+
+		// Buffer over the mapped file pages, nothing is parsed or copied on host;
+		// the buffer keeps the mapping alive
+
+		buf_ = std::shared_ptr<myfcl::Buffer<T>>(new myfcl::Buffer<T>(dataset->template buffer<T>(context)),
+			[dataset](myfcl::Buffer<T>* buf){ delete buf; });
+	}
+
+	size_t x() const{
+		return x_;
+	}
+
+	size_t y() const{
+		return y_;
+	}
+
+	size_t ld() const{
+		return ld_;
+	}
+
+	myfcl::Buffer<T>& buffer() const{
+		return *buf_;
+	}
+
+	std::vector<DeviceCheck> const& checks() const{
+		return checks_;
+	}
+
+	std::future<Matrix<T>> read(myfcl::Queue& queue) const{
+
+		// Brings the matrix to host once the queue gets here, failed checks throw from the future
+
+		auto buf = buf_;
+		auto checks = checks_;
+
+		queue.add(myfcl::ReadAsync{*buf});
+
+		for(auto const& check: checks)
+			queue.add(myfcl::ReadAsync{*check.flag});
+
+		return queue.whenDone([buf, checks, x = x_, y = y_, ld = ld_]{
+			for(auto const& check: checks)
+				if(check.flag->begin()[0] == check.failure)
+					throw(std::logic_error{check.message});
+
+			Matrix<T> ret{x, y, ld};
+			std::copy(buf->begin(), buf->end(), ret.data().begin());
+			return ret;
+		});
+	}
+};
+
+template<typename T>
+std::vector<DeviceCheck> joined_checks(DeviceMatrix<T> const& mat1, DeviceMatrix<T> const& mat2){
+	std::vector<DeviceCheck> ret = mat1.checks();
+	ret.insert(ret.end(), mat2.checks().begin(), mat2.checks().end());
+	return ret;
+}
+
+template<typename T>
+DeviceMatrix<T> mat_mult_async(DeviceMatrix<T> const& mat1, DeviceMatrix<T> const& mat2, myfcl::Context const& context, myfcl::Queue& queue){
+
+	//Enqueues multiplication of 2 device matrices, result is dense
+
+	if(mat1.x() != mat2.y())
+		throw(std::logic_error("Matrices sizes are incompatible"));
+
+	cl_int M = mat1.y(), N = mat2.x(), K = mat1.x();
+
+	auto ret = std::make_shared<myfcl::Buffer<T>>(context, M * N);
+
+	myfcl::Program const& prog = gemm_program(context, TR_NONE, TR_NONE, M, N, K, mat1.ld(), mat2.ld(), N);
+
+	enqueue_gemm<T>(prog, queue, TR_NONE, TR_NONE, M, N, K, static_cast<T>(1), mat1.buffer(), mat1.ld(), mat2.buffer(), mat2.ld(), static_cast<T>(0), *ret, N);
+
+	return DeviceMatrix<T>{ret, static_cast<size_t>(N), static_cast<size_t>(M), static_cast<size_t>(N), joined_checks(mat1, mat2)};
+}
+
+DeviceMatrix<int> mat_transpose_async(DeviceMatrix<int> const& mat, myfcl::Context const& context, myfcl::Queue& queue){
+
+	//Enqueues transpose of a device matrix, padded rows are allowed, result is dense
+
+	auto ret = std::make_shared<myfcl::Buffer<int>>(context, mat.x() * mat.y());
+
+	myfcl::Program const& prog = context.getProgram("matrices.cl");
+	myfcl::Kernel transpose{prog, "matrix_transpose"};
+
+	int X = mat.x();
+	int Y = mat.y();
+	int LDA = mat.ld();
+
+	transpose.addArgument(0, &mat.buffer().buffer());
+	transpose.addArgument(1, &ret->buffer());
+	transpose.addArgument(2, &X);
+	transpose.addArgument(3, &Y);
+	transpose.addArgument(4, &LDA);
+	transpose.addArgument(5, &Y);
+
+	queue.add(myfcl::Execute{transpose, {{8}, {8}}, {{round_up(mat.x(), 8)}, {round_up(mat.y(), 8)}}});
+	queue.execute();
+
+	return DeviceMatrix<int>{ret, mat.y(), mat.x(), mat.y(), mat.checks()};
+}
+
+DeviceMatrix<double> mat_reverse_async(DeviceMatrix<double> const& mat, myfcl::Context const& context, myfcl::Queue& queue){
+
+	//Enqueues matrix reverse by gaussian method, zero determinant is reported when the result is read
+
+	if(mat.x() != mat.y() || mat.ld() != mat.x())
+		throw(std::logic_error("Matrix is required to be squared and dense"));
+
+	size_t size = mat.x();
+
+	Matrix<double> E = getEMatrix<double>(size);
+
+	auto temp = std::make_shared<myfcl::Buffer<double>>(context, size * size);
+	// initial values are copied at creation: a temporary result (e.g. chained into mat_mult_async)
+	// may be destroyed before the queue gets to pending writes of its host storage
+
+	auto ret = std::make_shared<myfcl::Buffer<double>>(context, std::move(E.data()), CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR);
+	auto err = std::make_shared<myfcl::Buffer<int>>(context, myfcl::aligned_vector<int>{-2}, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR);
+
+	myfcl::Program const& prog = specialized_program(context, "matrices.cl", myfcl::BuildOptions{}.define("MATRIX_SIZE", size).str());
+	myfcl::Kernel simpl{prog, "matrix_simplify_column"};
+
+	int isize = size;
+
+	simpl.addArgument(0, &temp->buffer());
+	simpl.addArgument(1, &ret->buffer());
+	simpl.addArgument(2, &isize);
+	simpl.addArgument(4, &err->buffer());
+
+	queue.add(myfcl::Copy{mat.buffer(), *temp}); // kernel works in place, source stays intact
+	queue.execute();
+
+	size_t work_group_size = std::min(size, simpl.workGroupSize(context.getDevice()));
+
+	// no per-column read: after a zero pivot the flag stays set and remaining columns are skipped
+
+	for(int i = 0; i < isize; i++){
+		simpl.addArgument(3, &i);
+		queue.add(myfcl::Execute{simpl, {work_group_size}, {size}});
+		queue.execute();
+	}
+
+	std::vector<DeviceCheck> checks = mat.checks();
+	checks.push_back(DeviceCheck{err, -1, "Matrix can't be reversed(det == 0)"});
+
+	return DeviceMatrix<double>{ret, size, size, size, std::move(checks)};
+}
+
+//const int TRANSPOSE_TEST_SIZE = 1024;
+//const int REVERSE_TEST_SIZE = 128; // max stable size is ~ 128 
+
+constexpr size_t RANDOM_CHECK_SIZE = 1u << 12; // elements of device random stream compared to host one
+
+
+int main(int argc, char** argv){
+	int TRANSPOSE_TEST_SIZE = 1024, REVERSE_TEST_SIZE = 128;
+
+	for(int i = 0; i < argc; i++){
+		if(i == 1){
+			TRANSPOSE_TEST_SIZE = atoi(argv[i]);
+		}
+
+		if(i == 2){
+			REVERSE_TEST_SIZE = atoi(argv[i]);
+		}
+
+	}
+
+
+	bool err_catched = false;
+
+	try{
+
+		myfcl::Context context{myfcl::bestDevice(CL_DEVICE_TYPE_ALL, true)}; // reverse and refinement need double precision
+
+		// all builds start at once, every check below waits only for its own program
+
+		context.warmUp({{"matrices.cl", ""}, {"gemm.cl", ""}, {"lu.cl", ""}, {"sparse.cl", ""}, {"random.cl", ""}, {"validate.cl", ""},
+						{"matrices.cl", myfcl::BuildOptions{}.define("MATRIX_SIZE", REVERSE_TEST_SIZE).str()}});
+
+		std::cout << ">Checking matrix transpose" << std::endl;
+		
+		Matrix<int> mat{TRANSPOSE_TEST_SIZE};
+
+		mat.randomize(context, 1, 10);
+
+		{
+			// stream is counter-based, its head is enough to catch a generator mismatch
+
+			std::vector<cl_int> expected(std::min<size_t>(mat.data().size(), RANDOM_CHECK_SIZE));
+			myfcl::hostRandomRange(expected.data(), expected.size(), -5, 5, 1);
+
+			if(!std::equal(expected.begin(), expected.end(), mat.data().begin()))
+				throw(std::logic_error{"Device random numbers differ from host ones"});
+		}
+
+		Matrix<int> transpose = mat_transpose(mat, context);
+
+		require_transposed(mat, transpose);
+
+		Matrix<int> padded{123, 45, context}; // rows padded to device alignment, ld != x
+
+		padded.randomize(10);
+
+		require_transposed(padded, mat_transpose(padded, context));
+
+		std::cout << "Test completed successfully" << std::endl << std::endl;
+
+
+		std::cout << ">Checking general matrix multiplication" << std::endl;
+
+		for(int transA = 0; transA < 2; transA++)
+			for(int transB = 0; transB < 2; transB++){
+				size_t M = 37, N = 53, K = 19;
+
+				// rows padded to device alignment, so leading dimensions differ from widths
+
+				Matrix<int> A = transA ? Matrix<int>{M, K, context} : Matrix<int>{K, M, context};
+				Matrix<int> B = transB ? Matrix<int>{K, N, context} : Matrix<int>{N, K, context};
+				Matrix<int> C{N, M, context};
+
+				A.randomize(10);
+				B.randomize(10);
+				C.randomize(10);
+
+				Matrix<int> ref = C;
+
+				// repeated shape switches from generic to specialized program
+
+				for(int call = 0; call < SPECIALIZE_AFTER; call++){
+					gemm(Transpose(transA), Transpose(transB), 2, A, A.ld(), B, B.ld(), -3, C, C.ld(), context);
+					ref_gemm(Transpose(transA), Transpose(transB), 2, A, B, -3, ref);
+
+					if(C.data() != ref.data())
+						throw(std::logic_error{"gemm result differs from reference"});
+				}
+			}
+
+		std::cout << "Test completed successfully" << std::endl << std::endl;
+
+
+		std::cout << ">Checking concurrent multiplications on executor" << std::endl;
+
+		{
+			myfcl::Executor executor{context, 4};
+
+			std::vector<Matrix<int>> lhs, rhs;
+			std::vector<std::future<Matrix<int>>> products;
+
+			for(size_t i = 0; i < 8; i++){
+				lhs.emplace_back(20 + i, 30);
+				rhs.emplace_back(40, 20 + i);
+				lhs.back().randomize(10);
+				rhs.back().randomize(10);
+			}
+
+			for(size_t i = 0; i < lhs.size(); i++)
+				products.push_back(executor.submit([&context, &a = lhs[i], &b = rhs[i]](myfcl::Queue& queue){
+					return mat_mult(a, b, context, &queue);
+				}));
+
+			for(size_t i = 0; i < products.size(); i++){
+				Matrix<int> ref{40, 30};
+				ref_gemm(TR_NONE, TR_NONE, 1, lhs[i], rhs[i], 0, ref);
+
+				if(products[i].get().data() != ref.data())
+					throw(std::logic_error{"Concurrent product differs from reference"});
+			}
+		}
+
+		std::cout << "Test completed successfully" << std::endl << std::endl;
+
+
+		std::cout << ">Checking multiplication split between CPU NUMA nodes" << std::endl;
+
+		std::unique_ptr<myfcl::Context> numa;
+
+		try{
+			numa = std::make_unique<myfcl::Context>(myfcl::bestDevice(CL_DEVICE_TYPE_CPU), myfcl::PARTITION_BY_NUMA);
+		}
+		catch(myfcl::Exception const& e){
+			std::cout << "CPU device can't be split by NUMA nodes, skipped: " << e.what() << std::endl << std::endl;
+		}
+
+		if(numa){
+			Matrix<float> A{300, 200, *numa}, B{150, 300, *numa}, C{150, 200, *numa};
+
+			A.randomize(10);
+			B.randomize(10);
+			C.randomize(10);
+
+			Matrix<float> ref = C;
+
+			gemm(TR_NONE, TR_NONE, 1.0f, A, A.ld(), B, B.ld(), 2.0f, C, C.ld(), *numa);
+			ref_gemm(TR_NONE, TR_NONE, 1.0f, A, B, 2.0f, ref);
+
+			for(size_t j = 0; j < C.y(); j++)
+				for(size_t i = 0; i < C.x(); i++)
+					if(C(j, i) != ref(j, i))
+						throw(std::logic_error{"Partitioned gemm result differs from reference"});
+
+			std::cout << "Test completed successfully on " << numa->getNumOfDevices() << " partitions" << std::endl << std::endl;
+		}
+
+
+		std::cout << ">Checking matrix views and buffer hand-over" << std::endl;
+
+		{
+			Matrix<int> mat{45, 30, context};
+			mat.randomize(100);
+
+			Matrix<int> sub{mat.view().sub(5, 7, 20, 10)};
+
+			for(size_t j = 0; j < sub.y(); j++)
+				for(size_t i = 0; i < sub.x(); i++)
+					if(sub(j, i) != mat(j + 7, i + 5))
+						throw(std::logic_error{"Submatrix view differs from matrix"});
+
+			Matrix<int> expected = mat;
+			size_t x = mat.x(), y = mat.y(), ld = mat.ld();
+			const int* storage = mat.data().data();
+
+			myfcl::Buffer<int> buf = std::move(mat).toBuffer(context);
+
+			if(buf.hostData() != storage || reinterpret_cast<uintptr_t>(storage) % context.baseAddrAlign() != 0)
+				throw(std::logic_error{"Matrix storage was copied or is not aligned"});
+
+			myfcl::Queue queue{context};
+			queue.add(myfcl::Write{buf});
+			queue.execute(); // tasks run at execute(), the upload has to happen before host data is cleared
+
+			std::fill(buf.begin(), buf.end(), 0);
+			queue.add(myfcl::Read{buf});
+			queue.execute();
+
+			Matrix<int> back{std::move(buf), x, y, ld};
+
+			if(back.data() != expected.data())
+				throw(std::logic_error{"Matrix changed on its way through buffer"});
+		}
+
+		std::cout << "Test completed successfully" << std::endl << std::endl;
+
+
+		std::cout << ">Checking LU factorization and solve" << std::endl;
+
+		Matrix<double> matA{REVERSE_TEST_SIZE};
+		matA.randomize(100);
+
+		LUFactor<double> lu{matA, context};
+
+		for(size_t nrhs: {1, 64}){
+			Matrix<double> B{nrhs, static_cast<size_t>(REVERSE_TEST_SIZE)};
+			B.randomize(100);
+
+			Matrix<double> X = B;
+			lu.solve(X);
+
+			if(max_residual(matA, X, B) > 1e-6)
+				throw(std::logic_error{"LU solve residual is too big"});
+		}
+
+		Matrix<double> matAInv = lu.inverse();
+		Matrix<double> luE = mat_mult(matA, matAInv, context);
+
+		require_E<double>(luE);
+
+		std::cout << "Test completed successfully" << std::endl << std::endl;
+
+
+		std::cout << ">Checking mixed precision reverse" << std::endl;
+
+		RefineReport report;
+
+		Matrix<double> matRefined = mat_reverse_refined(matA, context, &report);
+		Matrix<double> refinedE = mat_mult(matA, matRefined, context);
+
+		require_E<double>(refinedE);
+
+		std::cout << "Refined in " << report.iterations << " iterations, residual " << report.residual << std::endl;
+		std::cout << "Test completed successfully" << std::endl << std::endl;
+
+
+		std::cout << ">Checking sparse matrix multiplication" << std::endl;
+
+		for(double density: {0.005, 0.2}){
+			Matrix<double> dense = getSparseMatrix<double>(1000, 700, density);
+			CSRMatrix<double> sparse{dense};
+
+			if(sparse.toDense().data() != dense.data())
+				throw(std::logic_error{"CSR conversion is not reversible"});
+
+			Matrix<double> vec{1, 1000};
+			vec.randomize(10);
+
+			Matrix<double> ref{1, 700};
+			ref_gemm(TR_NONE, TR_NONE, 1.0, dense, vec, 0.0, ref);
+
+			std::vector<double> product = spmv(sparse, vec.data(), context);
+
+			if(!std::equal(product.begin(), product.end(), ref.data().begin(), ref.data().end()))
+				throw(std::logic_error{"spmv result differs from reference"});
+
+			Matrix<double> mat{37, 1000};
+			mat.randomize(10);
+
+			Matrix<double> refMat{37, 700};
+			ref_gemm(TR_NONE, TR_NONE, 1.0, dense, mat, 0.0, refMat);
+
+			if(spmm(sparse, mat, context).data() != refMat.data())
+				throw(std::logic_error{"spmm result differs from reference"});
+
+			std::cout << "Mean row length " << sparse.meanRowLength() << ": ok" << std::endl;
+		}
+
+		std::cout << "Test completed successfully" << std::endl << std::endl;
+
+
+		std::cout << ">Checking matrix reverse and multiplication" << std::endl;
+
+		Matrix<double> matRef{REVERSE_TEST_SIZE};
+		matRef.randomize(100);
+
+		
+		Matrix<double> matRev = mat_reverse(matRef, context);
+
+		Matrix<double> probably_E = mat_mult(matRef, matRev, context);
+
+		require_E<double>(probably_E);
+
+		std::cout << "Test completed successfully" << std::endl << std::endl;
+
+
+		std::cout << ">Checking asynchronous reverse, multiplication and transpose" << std::endl;
+
+		{
+			myfcl::Queue queue{context};
+
+			// reverse result goes to multiplication on device, only the product is read back
+
+			DeviceMatrix<double> A{matRef, context};
+			std::future<Matrix<double>> product = mat_mult_async(mat_reverse_async(A, context, queue), A, context, queue).read(queue);
+
+			// host preparation of the next inputs overlaps device work already enqueued
+
+			Matrix<int> mat{300, 200};
+			mat.randomize(10);
+
+			DeviceMatrix<int> T{mat, context};
+			DeviceMatrix<int> Tt = mat_transpose_async(T, context, queue);
+			std::future<Matrix<int>> transposed = Tt.read(queue);
+			std::future<Matrix<int>> twice = mat_transpose_async(mat_transpose_async(T, context, queue), context, queue).read(queue);
+
+			Matrix<double> singular{4};
+			singular.setNull();
+
+			std::future<Matrix<double>> failed = mat_reverse_async(DeviceMatrix<double>{singular, context}, context, queue).read(queue);
+
+			require_E<double>(product.get());
+
+			Matrix<int> t = transposed.get();
+			require_transposed(mat, t);
+
+			// same check on device, without reading the operands back
+
+			myfcl::Validation on_device = myfcl::deviceTransposed(context, queue, T.buffer(), T.x(), T.y(), T.ld(), Tt.buffer(), Tt.ld());
+
+			if(!on_device.passed)
+				throw(std::logic_error{"Device validator rejects transpose"});
+
+			Matrix<int> broken = t;
+			broken(7, 5) += 1;
+
+			DeviceMatrix<int> B{broken, context};
+			on_device = myfcl::deviceTransposed(context, queue, T.buffer(), T.x(), T.y(), T.ld(), B.buffer(), B.ld());
+
+			if(on_device.passed || on_device.first_bad != 5 * T.x() + 7)
+				throw(std::logic_error{"Device validator misses broken transpose"});
+
+			if(twice.get().data() != mat.data())
+				throw(std::logic_error{"Double transpose differs from matrix"});
+
+			bool singular_reported = false;
+
+			try{
+				failed.get();
+			}
+			catch(std::logic_error const&){
+				singular_reported = true;
+			}
+
+			if(!singular_reported)
+				throw(std::logic_error{"Singular matrix was reversed"});
+		}
+
+		std::cout << "Checking matrix loaded from a mapped dataset..." << std::endl;
+
+		{
+			std::string path = "matrices_input.myds";
+
+			Matrix<int> mat{123, 77, context}; // padded rows are stored as they are
+			mat.randomize(context, 3, 20);
+
+			myfcl::saveDataset(path, mat.data().data(), mat.x(), mat.y(), mat.ld());
+
+			{
+				auto dataset = std::make_shared<myfcl::Dataset>(path);
+				myfcl::Queue queue{context};
+
+				Matrix<int> t = mat_transpose_async(DeviceMatrix<int>{dataset, context}, context, queue).read(queue).get();
+
+				MatrixView<int> view = dataset_view<int>(*dataset);
+
+				if(!myfcl::hostTransposed(view.data(), view.x(), view.y(), view.ld(), t.data().data(), t.ld()).passed)
+					throw(std::logic_error{"Mapped matrix is not transposed properly"});
+			}
+
+			std::remove(path.c_str());
+		}
 
 		std::cout << "Test completed successfully" << std::endl << std::endl;
 	}
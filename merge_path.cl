@@ -0,0 +1,65 @@
+// Merge path: parallel merge of two sorted arrays
+//
+// Output position d (a diagonal of the merge matrix) is produced from first i
+// elements of a and first d - i elements of b, i is found by binary search.
+// Work-groups get equal output ranges from merge_partition, then every
+// work-item searches its own diagonal inside group's window and merges
+// MERGE_ITEMS elements sequentially, so work is O(N) and perfectly balanced.
+//
+// Merge is stable: on equal keys elements of a go first.
+
+#define MERGE_ITEMS 8
+
+#define BEFORE(X, Y, UP) ((UP) ? (X) <= (Y) : (X) >= (Y))
+
+#define MERGE_KERNELS(T, SUFFIX) \
+\
+uint merge_path_search_##SUFFIX(__global const T* a, uint na, __global const T* b, uint nb, uint diag, int up){ \
+	uint lo = diag > nb ? diag - nb : 0; \
+	uint hi = min(diag, na); \
+\
+	while(lo < hi){ \
+		uint mid = (lo + hi) / 2; \
+		if(BEFORE(a[mid], b[diag - 1 - mid], up)) \
+			lo = mid + 1; \
+		else \
+			hi = mid; \
+	} \
+\
+	return lo; \
+} \
+\
+__kernel void merge_partition_##SUFFIX( \
+	__global const T* a, uint na, __global const T* b, uint nb, __global uint* partitions, uint items_per_group, int up){ \
+	uint id = get_global_id(0); \
+	uint diag = min(id * items_per_group, na + nb); \
+\
+	partitions[id] = merge_path_search_##SUFFIX(a, na, b, nb, diag, up); \
+} \
+\
+__kernel void merge_path_##SUFFIX( \
+	__global const T* a, uint na, __global const T* b, uint nb, __global T* out, __global const uint* partitions, int up){ \
+	uint group = get_group_id(0); \
+	uint items_per_group = get_local_size(0) * MERGE_ITEMS; \
+\
+	uint diag0 = min(group * items_per_group, na + nb); \
+	uint diag1 = min(diag0 + items_per_group, na + nb); \
+\
+	uint a0 = partitions[group], a1 = partitions[group + 1]; \
+	uint b0 = diag0 - a0, b1 = diag1 - a1; \
+\
+	uint d = min((uint)get_local_id(0) * MERGE_ITEMS, diag1 - diag0); \
+	uint end = min(d + MERGE_ITEMS, diag1 - diag0); \
+\
+	uint i = a0 + merge_path_search_##SUFFIX(a + a0, a1 - a0, b + b0, b1 - b0, d, up); \
+	uint j = b0 + d - (i - a0); \
+\
+	for(uint k = diag0 + d; k < diag0 + end; k++){ \
+		bool take_a = j >= b1 || (i < a1 && BEFORE(a[i], b[j], up)); \
+		out[k] = take_a ? a[i++] : b[j++]; \
+	} \
+}
+
+MERGE_KERNELS(int, int)
+
+MERGE_KERNELS(float, float)
@@ -0,0 +1,139 @@
+// LSD radix sort: RADIX_BITS bits of the key are processed per pass
+//
+// Every pass is histogram -> exclusive scan of histograms -> scatter.
+// Histograms are stored digit-major (hist[digit * groups + group]), so one
+// exclusive scan over the whole array gives every work-group its global offset
+// for every digit.
+//
+// Keys are sorted as unsigned integers of (key ^ flip), so the host picks flip
+// to get signed order and/or descending order.
+
+#define RADIX_BITS 4
+#define RADIX (1 << RADIX_BITS)
+#define RADIX_GROUP_SIZE 256
+
+
+// Work-group wide exclusive scan of one uint per work-item, returns the total
+
+uint group_scan_exclusive(__local uint* tmp, uint value, uint* total){
+	uint lid = get_local_id(0);
+	uint size = get_local_size(0);
+
+	tmp[lid] = value;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for(uint offset = 1; offset < size; offset <<= 1){
+		uint add = lid >= offset ? tmp[lid - offset] : 0;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		tmp[lid] += add;
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	uint inclusive = tmp[lid];
+	*total = tmp[size - 1];
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	return inclusive - value;
+}
+
+__kernel void scan_block(__global uint* data, __global uint* block_sums, uint n){
+	__local uint tmp[RADIX_GROUP_SIZE];
+
+	uint id = get_global_id(0);
+	uint total;
+
+	uint value = id < n ? data[id] : 0;
+	uint scanned = group_scan_exclusive(tmp, value, &total);
+
+	if(id < n)
+		data[id] = scanned;
+
+	if(get_local_id(0) == 0)
+		block_sums[get_group_id(0)] = total;
+}
+
+__kernel void scan_add(__global uint* data, __global const uint* block_sums, uint n){
+	uint id = get_global_id(0);
+
+	if(id < n)
+		data[id] += block_sums[get_group_id(0)];
+}
+
+
+#define RADIX_KERNELS(KEY, SUFFIX) \
+\
+__kernel void radix_histogram_##SUFFIX( \
+	__global const KEY* keys, uint n, KEY flip, uint shift, __global uint* hist){ \
+	__local uint counts[RADIX]; \
+\
+	uint id = get_global_id(0); \
+	uint lid = get_local_id(0); \
+\
+	if(lid < RADIX) \
+		counts[lid] = 0; \
+	barrier(CLK_LOCAL_MEM_FENCE); \
+\
+	if(id < n) \
+		atomic_inc(&counts[(uint)(((keys[id] ^ flip) >> shift) & (RADIX - 1))]); \
+	barrier(CLK_LOCAL_MEM_FENCE); \
+\
+	if(lid < RADIX) \
+		hist[lid * get_num_groups(0) + get_group_id(0)] = counts[lid]; \
+} \
+\
+/* Stable scatter: the group first sorts its items by digit with RADIX_BITS 1-bit splits */ \
+/* in local memory, then every item goes to its digit's global offset plus its local rank */ \
+\
+__kernel void radix_scatter_##SUFFIX( \
+	__global const KEY* keys_in, __global KEY* keys_out, \
+	__global const uint* vals_in, __global uint* vals_out, \
+	uint n, KEY flip, uint shift, __global const uint* hist){ \
+	__local KEY lkeys[RADIX_GROUP_SIZE]; \
+	__local uint lvals[RADIX_GROUP_SIZE]; \
+	__local uint tmp[RADIX_GROUP_SIZE]; \
+	__local uint digit_start[RADIX]; \
+\
+	uint id = get_global_id(0); \
+	uint lid = get_local_id(0); \
+	uint group = get_group_id(0); \
+\
+	uint n_valid = min((uint)get_local_size(0), n - group * (uint)get_local_size(0)); \
+\
+	/* out of range items get all digit bits set and stay behind valid ones */ \
+	KEY key = id < n ? keys_in[id] : ~flip; \
+	uint val = (id < n && vals_in) ? vals_in[id] : 0; \
+\
+	for(uint b = 0; b < RADIX_BITS; b++){ \
+		uint bit = (uint)(((key ^ flip) >> (shift + b)) & 1); \
+		uint zeros; \
+		uint zeros_before = group_scan_exclusive(tmp, 1 - bit, &zeros); \
+		uint pos = bit ? zeros + lid - zeros_before : zeros_before; \
+\
+		lkeys[pos] = key; \
+		lvals[pos] = val; \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+\
+		key = lkeys[lid]; \
+		val = lvals[lid]; \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+	} \
+\
+	uint digit = (uint)(((key ^ flip) >> shift) & (RADIX - 1)); \
+	tmp[lid] = digit; \
+	barrier(CLK_LOCAL_MEM_FENCE); \
+\
+	if(lid == 0 || tmp[lid - 1] != digit) \
+		digit_start[digit] = lid; \
+	barrier(CLK_LOCAL_MEM_FENCE); \
+\
+	if(lid < n_valid){ \
+		uint dst = hist[digit * get_num_groups(0) + group] + lid - digit_start[digit]; \
+		keys_out[dst] = key; \
+		if(vals_out) \
+			vals_out[dst] = val; \
+	} \
+}
+
+RADIX_KERNELS(uint, 32)
+
+RADIX_KERNELS(ulong, 64)
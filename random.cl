@@ -0,0 +1,93 @@
+// Counter-based random numbers: Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3")
+//
+// Block b of a sequence is philox(counter = b, key = seed), four 32-bit words. Work-items
+// compute their blocks independently, so output depends on seed and element index only.
+// Every conversion below is integer arithmetic or an exactly rounded float operation
+// (contraction is off), which makes output bit-identical to the host version in random.hpp:
+//	uniform - float from 24 bits (4 per block), double from 53 bits (2 per block), in [0, 1)
+//	range   - int in [lo, lo + range) by multiply-shift, 4 per block
+//	normal  - sum of 12 uniforms minus 6 (Irwin-Hall), 3 blocks per element, cut at 6 sigma
+
+#pragma OPENCL FP_CONTRACT OFF
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+uint4 philox_block(ulong index, ulong seed){
+	uint4 ctr = (uint4)((uint)index, (uint)(index >> 32), 0, 0);
+	uint2 key = (uint2)((uint)seed, (uint)(seed >> 32));
+
+	for(int round = 0; round < 10; round++){
+		if(round != 0)
+			key += (uint2)(PHILOX_W0, PHILOX_W1);
+
+		uint hi0 = mul_hi(PHILOX_M0, ctr.x), lo0 = PHILOX_M0 * ctr.x;
+		uint hi1 = mul_hi(PHILOX_M1, ctr.z), lo1 = PHILOX_M1 * ctr.z;
+
+		ctr = (uint4)(hi1 ^ ctr.y ^ key.x, lo1, hi0 ^ ctr.w ^ key.y, lo0);
+	}
+
+	return ctr;
+}
+
+int irwin_hall(ulong index, ulong seed){ // sum of 12 24-bit uniforms minus 6, scaled by 2^24
+	int sum = -6 << 24;
+
+	for(int b = 0; b < 3; b++){
+		uint4 r = philox_block(index * 3 + b, seed);
+		sum += (r.x >> 8) + (r.y >> 8) + (r.z >> 8) + (r.w >> 8);
+	}
+
+	return sum;
+}
+
+__kernel void random_uniform_float(__global float* out, ulong count, ulong seed){
+	ulong block = get_global_id(0);
+	uint4 r = philox_block(block, seed);
+	uint words[4] = {r.x, r.y, r.z, r.w};
+
+	for(int i = 0; i < 4; i++)
+		if(block * 4 + i < count)
+			out[block * 4 + i] = (words[i] >> 8) * 0x1.0p-24f;
+}
+
+__kernel void random_range_int(__global int* out, ulong count, ulong seed, int lo, uint range){
+	ulong block = get_global_id(0);
+	uint4 r = philox_block(block, seed);
+	uint words[4] = {r.x, r.y, r.z, r.w};
+
+	for(int i = 0; i < 4; i++)
+		if(block * 4 + i < count)
+			out[block * 4 + i] = (int)((uint)lo + (uint)(((ulong)words[i] * range) >> 32));
+}
+
+__kernel void random_normal_float(__global float* out, ulong count, ulong seed, float mean, float stddev){
+	ulong index = get_global_id(0);
+
+	if(index < count)
+		out[index] = mean + stddev * (irwin_hall(index, seed) * 0x1.0p-24f);
+}
+
+#ifdef cl_khr_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+
+__kernel void random_uniform_double(__global double* out, ulong count, ulong seed){
+	ulong block = get_global_id(0);
+	uint4 r = philox_block(block, seed);
+	ulong bits[2] = {((ulong)(r.x >> 5) << 26) | (r.y >> 6), ((ulong)(r.z >> 5) << 26) | (r.w >> 6)};
+
+	for(int i = 0; i < 2; i++)
+		if(block * 2 + i < count)
+			out[block * 2 + i] = bits[i] * 0x1.0p-53;
+}
+
+__kernel void random_normal_double(__global double* out, ulong count, ulong seed, double mean, double stddev){
+	ulong index = get_global_id(0);
+
+	if(index < count)
+		out[index] = mean + stddev * (irwin_hall(index, seed) * 0x1.0p-24);
+}
+
+#endif
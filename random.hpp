@@ -0,0 +1,171 @@
+#pragma once
+
+#include "MyFrameCL.hpp"
+
+/*
+	random.hpp
+
+	Seedable random fill of buffers on device (kernels are in random.cl) and host
+	versions producing bit-identical output, for verification or as a fallback.
+	Element i depends on seed and i only, so results don't depend on device or work sizes.
+
+*/
+
+namespace myfcl{
+
+inline std::array<uint32_t, 4> philoxBlock(uint64_t index, uint64_t seed){
+
+	// Philox4x32-10, same as philox_block of random.cl
+
+	std::array<uint32_t, 4> ctr{static_cast<uint32_t>(index), static_cast<uint32_t>(index >> 32), 0, 0};
+	uint32_t key[2] = {static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)};
+
+	for(int round = 0; round < 10; round++){
+		if(round != 0){
+			key[0] += 0x9E3779B9u;
+			key[1] += 0xBB67AE85u;
+		}
+
+		uint64_t prod0 = static_cast<uint64_t>(0xD2511F53u) * ctr[0];
+		uint64_t prod1 = static_cast<uint64_t>(0xCD9E8D57u) * ctr[2];
+
+		ctr = {static_cast<uint32_t>(prod1 >> 32) ^ ctr[1] ^ key[0], static_cast<uint32_t>(prod1),
+			   static_cast<uint32_t>(prod0 >> 32) ^ ctr[3] ^ key[1], static_cast<uint32_t>(prod0)};
+	}
+
+	return ctr;
+}
+
+inline int32_t irwinHall(uint64_t index, uint64_t seed){
+
+	// Sum of 12 24-bit uniforms minus 6, scaled by 2^24
+
+	uint32_t sum = static_cast<uint32_t>(-6) << 24;
+
+	for(int b = 0; b < 3; b++)
+		for(uint32_t word: philoxBlock(index * 3 + b, seed))
+			sum += word >> 8;
+
+	return static_cast<int32_t>(sum);
+}
+
+template<typename T>
+struct random_kernel{
+};
+
+template<>
+struct random_kernel<float>{
+	static constexpr const char* uniform = "random_uniform_float";
+	static constexpr const char* normal = "random_normal_float";
+	static constexpr size_t per_block = 4;
+
+	static float uniform_value(std::array<uint32_t, 4> const& r, size_t i){
+		return static_cast<float>(r[i] >> 8) * 0x1.0p-24f;
+	}
+};
+
+template<>
+struct random_kernel<double>{
+	static constexpr const char* uniform = "random_uniform_double";
+	static constexpr const char* normal = "random_normal_double";
+	static constexpr size_t per_block = 2;
+
+	static double uniform_value(std::array<uint32_t, 4> const& r, size_t i){
+		uint64_t bits = (static_cast<uint64_t>(r[2 * i] >> 5) << 26) | (r[2 * i + 1] >> 6);
+		return static_cast<double>(bits) * 0x1.0p-53;
+	}
+};
+
+template<typename T>
+void randomUniform(Context const& ct, Queue& queue, Buffer<T>& buf, uint64_t seed){
+
+	// Enqueues fill of buf with uniform values in [0, 1), host data of buf is left as is
+
+	cl_ulong count = buf.size() / sizeof(T);
+	cl_ulong key = seed;
+
+	Kernel kernel{ct.getProgram("random.cl"), random_kernel<T>::uniform};
+
+	kernel.addArgument(0, &buf.buffer());
+	kernel.addArgument(1, &count);
+	kernel.addArgument(2, &key);
+
+	queue.add(Execute{kernel, {}, {(count + random_kernel<T>::per_block - 1) / random_kernel<T>::per_block}});
+	queue.execute();
+}
+
+inline void randomRange(Context const& ct, Queue& queue, Buffer<cl_int>& buf, cl_int lo, cl_int hi, uint64_t seed){
+
+	// Enqueues fill of buf with integers uniform in [lo, hi)
+
+	if(hi <= lo)
+		throw(Exception{"Random range is empty"});
+
+	cl_ulong count = buf.size() / sizeof(cl_int);
+	cl_ulong key = seed;
+	cl_uint range = static_cast<cl_uint>(hi) - static_cast<cl_uint>(lo);
+
+	Kernel kernel{ct.getProgram("random.cl"), "random_range_int"};
+
+	kernel.addArgument(0, &buf.buffer());
+	kernel.addArgument(1, &count);
+	kernel.addArgument(2, &key);
+	kernel.addArgument(3, &lo);
+	kernel.addArgument(4, &range);
+
+	queue.add(Execute{kernel, {}, {(count + 3) / 4}});
+	queue.execute();
+}
+
+template<typename T>
+void randomNormal(Context const& ct, Queue& queue, Buffer<T>& buf, T mean, T stddev, uint64_t seed){
+
+	// Enqueues fill of buf with approximately normal values, tails are cut at 6 * stddev
+
+	cl_ulong count = buf.size() / sizeof(T);
+	cl_ulong key = seed;
+
+	Kernel kernel{ct.getProgram("random.cl"), random_kernel<T>::normal};
+
+	kernel.addArgument(0, &buf.buffer());
+	kernel.addArgument(1, &count);
+	kernel.addArgument(2, &key);
+	kernel.addArgument(3, &mean);
+	kernel.addArgument(4, &stddev);
+
+	queue.add(Execute{kernel, {}, {count}});
+	queue.execute();
+}
+
+// Host versions, out[i] equals element i of the device fill with the same seed
+
+template<typename T>
+void hostRandomUniform(T* out, size_t count, uint64_t seed){
+	constexpr size_t per_block = random_kernel<T>::per_block;
+
+	for(size_t block = 0; block * per_block < count; block++){
+		std::array<uint32_t, 4> r = philoxBlock(block, seed);
+
+		for(size_t i = 0; i < per_block && block * per_block + i < count; i++)
+			out[block * per_block + i] = random_kernel<T>::uniform_value(r, i);
+	}
+}
+
+inline void hostRandomRange(cl_int* out, size_t count, cl_int lo, cl_int hi, uint64_t seed){
+	uint32_t range = static_cast<uint32_t>(hi) - static_cast<uint32_t>(lo);
+
+	for(size_t block = 0; block * 4 < count; block++){
+		std::array<uint32_t, 4> r = philoxBlock(block, seed);
+
+		for(size_t i = 0; i < 4 && block * 4 + i < count; i++)
+			out[block * 4 + i] = static_cast<cl_int>(static_cast<uint32_t>(lo) + static_cast<uint32_t>((static_cast<uint64_t>(r[i]) * range) >> 32));
+	}
+}
+
+template<typename T>
+void hostRandomNormal(T* out, size_t count, T mean, T stddev, uint64_t seed){
+	for(size_t i = 0; i < count; i++)
+		out[i] = mean + stddev * (static_cast<T>(irwinHall(i, seed)) * static_cast<T>(0x1.0p-24));
+}
+
+}
@@ -0,0 +1,109 @@
+// Sparse matrix (CSR) by dense vector/matrix products
+//
+// Row i of CSR matrix has values[k] at columns col_idx[k], k in [row_ptr[i], row_ptr[i + 1]).
+// Scalar kernels give a work-item to every row (or every row/column pair of the result),
+// which is best for short rows. Vector kernels give a whole work-group to every row and
+// suit long rows: SpMV splits row's entries between lanes and reduces partial sums,
+// SpMM stages row's entries in local memory and shares them between result columns.
+
+#define SPMV_VECTOR_SIZE 32
+#define SPMM_CHUNK 256
+
+#define SPARSE_KERNELS(T, SUFFIX) \
+\
+__kernel void spmv_scalar_##SUFFIX(int rows, __global const int* row_ptr, __global const int* col_idx, \
+	__global const T* values, __global const T* x, __global T* y){ \
+	int row = get_global_id(0); \
+\
+	if(row >= rows) \
+		return; \
+\
+	T sum = 0; \
+\
+	for(int k = row_ptr[row]; k < row_ptr[row + 1]; k++) \
+		sum += values[k] * x[col_idx[k]]; \
+\
+	y[row] = sum; \
+} \
+\
+__kernel void spmv_vector_##SUFFIX(int rows, __global const int* row_ptr, __global const int* col_idx, \
+	__global const T* values, __global const T* x, __global T* y){ \
+	__local T partial[SPMV_VECTOR_SIZE]; \
+\
+	int row = get_group_id(0); \
+	int lane = get_local_id(0); \
+\
+	T sum = 0; \
+\
+	for(int k = row_ptr[row] + lane; k < row_ptr[row + 1]; k += SPMV_VECTOR_SIZE) \
+		sum += values[k] * x[col_idx[k]]; \
+\
+	partial[lane] = sum; \
+	barrier(CLK_LOCAL_MEM_FENCE); \
+\
+	for(int offset = SPMV_VECTOR_SIZE / 2; offset > 0; offset >>= 1){ \
+		if(lane < offset) \
+			partial[lane] += partial[lane + offset]; \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+	} \
+\
+	if(lane == 0) \
+		y[row] = partial[0]; \
+} \
+\
+__kernel void spmm_scalar_##SUFFIX(int rows, int cols, __global const int* row_ptr, __global const int* col_idx, \
+	__global const T* values, __global const T* B, int ldb, __global T* C, int ldc){ \
+	int col = get_global_id(0); \
+	int row = get_global_id(1); \
+\
+	if(col >= cols) \
+		return; \
+\
+	T sum = 0; \
+\
+	for(int k = row_ptr[row]; k < row_ptr[row + 1]; k++) \
+		sum += values[k] * B[col_idx[k] * ldb + col]; \
+\
+	C[row * ldc + col] = sum; \
+} \
+\
+__kernel void spmm_vector_##SUFFIX(int rows, int cols, __global const int* row_ptr, __global const int* col_idx, \
+	__global const T* values, __global const T* B, int ldb, __global T* C, int ldc){ \
+	__local T lvalues[SPMM_CHUNK]; \
+	__local int lcols[SPMM_CHUNK]; \
+\
+	int col = get_global_id(0); \
+	int row = get_global_id(1); \
+	int lid = get_local_id(0); \
+	int lsize = get_local_size(0); \
+\
+	int end = row_ptr[row + 1]; \
+	T sum = 0; \
+\
+	for(int base = row_ptr[row]; base < end; base += SPMM_CHUNK){ \
+		int len = min(SPMM_CHUNK, end - base); \
+\
+		for(int i = lid; i < len; i += lsize){ \
+			lvalues[i] = values[base + i]; \
+			lcols[i] = col_idx[base + i]; \
+		} \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+\
+		if(col < cols) \
+			for(int i = 0; i < len; i++) \
+				sum += lvalues[i] * B[lcols[i] * ldb + col]; \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+	} \
+\
+	if(col < cols) \
+		C[row * ldc + col] = sum; \
+}
+
+SPARSE_KERNELS(float, float)
+
+#ifdef cl_khr_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+
+SPARSE_KERNELS(double, double)
+
+#endif
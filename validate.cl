@@ -0,0 +1,56 @@
+// Result validators
+//
+// Every work-item checks one element and violations are reduced to the lowest failing index
+// with atomic_min, so first_bad keeps its initial value (element count) if everything passes.
+// Work-items behind an already found failure skip their check. Matrix indices are row-major
+// (row * width + column), element counts must fit int.
+
+#define VALIDATE_KERNELS(T, SUFFIX) \
+\
+__kernel void validate_sorted_##SUFFIX(__global const T* a, int count, int descending, volatile __global int* first_bad){ \
+	int i = get_global_id(0); \
+\
+	if(i + 1 >= count || i > *first_bad) \
+		return; \
+\
+	if(descending ? a[i] < a[i + 1] : a[i] > a[i + 1]) \
+		atomic_min(first_bad, i); \
+} \
+\
+__kernel void validate_transposed_##SUFFIX(__global const T* A, int X, int Y, int lda, __global const T* B, int ldb, \
+	volatile __global int* first_bad){ \
+	int col = get_global_id(0); \
+	int row = get_global_id(1); \
+	int i = row * X + col; \
+\
+	if(i > *first_bad) \
+		return; \
+\
+	if(A[row * lda + col] != B[col * ldb + row]) \
+		atomic_min(first_bad, i); \
+} \
+\
+__kernel void validate_identity_##SUFFIX(__global const T* A, int n, int lda, T tolerance, volatile __global int* first_bad){ \
+	int col = get_global_id(0); \
+	int row = get_global_id(1); \
+	int i = row * n + col; \
+\
+	if(i > *first_bad) \
+		return; \
+\
+	T diff = A[row * lda + col] - (row == col ? 1 : 0); \
+\
+	if(!(diff <= tolerance && -diff <= tolerance)) /* NaN fails too */ \
+		atomic_min(first_bad, i); \
+}
+
+VALIDATE_KERNELS(int, int)
+
+VALIDATE_KERNELS(float, float)
+
+#ifdef cl_khr_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+
+VALIDATE_KERNELS(double, double)
+
+#endif
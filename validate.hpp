@@ -0,0 +1,187 @@
+#pragma once
+
+#include "MyFrameCL.hpp"
+
+/*
+	validate.hpp
+
+	Checks of results: sorted order, transpose and identity within tolerance.
+	Device versions (kernels are in validate.cl) work on buffers without reading them
+	back, host versions split the data between all hardware threads. Both report the
+	first failing index, row-major for matrices, and stop early after a failure.
+
+*/
+
+namespace myfcl{
+
+struct Validation{
+	bool passed;
+	size_t first_bad; // lowest failing index, element count if passed
+};
+
+enum { VALIDATE_MIN_CHUNK = 1 << 16 }; // elements per host thread at least
+
+template<typename F>
+Validation hostValidate(size_t count, F const& failed){
+
+	// Checks failed(i) for every i in [0, count), each thread scans a contiguous range
+	// in order and quits once a failure before its position is known
+
+	size_t threads = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, std::max<size_t>(count / VALIDATE_MIN_CHUNK, 1));
+
+	std::atomic<size_t> first{count};
+
+	auto scan = [&](size_t begin, size_t end){
+		for(size_t i = begin; i < end; i++){
+			if(i % 4096 == 0 && i > first.load(std::memory_order_relaxed))
+				return;
+
+			if(failed(i)){
+				size_t known = first.load();
+				while(i < known && !first.compare_exchange_weak(known, i));
+				return;
+			}
+		}
+	};
+
+	std::vector<std::thread> pool;
+
+	for(size_t t = 1; t < threads; t++)
+		pool.emplace_back(scan, t * count / threads, (t + 1) * count / threads);
+
+	scan(0, count / threads);
+
+	for(auto& thread: pool)
+		thread.join();
+
+	return Validation{first == count, first};
+}
+
+template<typename T>
+Validation hostSorted(T const* data, size_t count, bool descending = false){
+	Validation ret = hostValidate(count > 1 ? count - 1 : 0, [=](size_t i){
+		return descending ? data[i] < data[i + 1] : data[i] > data[i + 1];
+	});
+
+	if(ret.passed)
+		ret.first_bad = count;
+
+	return ret;
+}
+
+template<typename T>
+Validation hostTransposed(T const* A, size_t x, size_t y, size_t lda, T const* B, size_t ldb){
+
+	// B is A transposed, A is y rows of x elements
+
+	return hostValidate(x * y, [=](size_t i){
+		size_t row = i / x, col = i % x;
+		return A[row * lda + col] != B[col * ldb + row];
+	});
+}
+
+template<typename T>
+Validation hostIdentity(T const* A, size_t n, size_t lda, T tolerance = T{}){
+	return hostValidate(n * n, [=](size_t i){
+		size_t row = i / n, col = i % n;
+		T diff = A[row * lda + col] - static_cast<T>(row == col ? 1 : 0);
+		return !(diff <= tolerance && -diff <= tolerance); // NaN fails too
+	});
+}
+
+template<typename T>
+struct validate_kernel{
+};
+
+template<>
+struct validate_kernel<cl_int>{
+	static constexpr const char* sorted = "validate_sorted_int";
+	static constexpr const char* transposed = "validate_transposed_int";
+	static constexpr const char* identity = "validate_identity_int";
+};
+
+template<>
+struct validate_kernel<float>{
+	static constexpr const char* sorted = "validate_sorted_float";
+	static constexpr const char* transposed = "validate_transposed_float";
+	static constexpr const char* identity = "validate_identity_float";
+};
+
+template<>
+struct validate_kernel<double>{
+	static constexpr const char* sorted = "validate_sorted_double";
+	static constexpr const char* transposed = "validate_transposed_double";
+	static constexpr const char* identity = "validate_identity_double";
+};
+
+inline Validation runValidation(Context const& ct, Queue& queue, Kernel& kernel, cl_uint flag_index, NDRange global, cl_int count){
+
+	// Sets the first_bad argument, runs kernel after everything already in queue and reads the flag
+
+	Buffer<cl_int> first_bad{ct, 1};
+	first_bad[0] = count;
+
+	kernel.addArgument(flag_index, &first_bad.buffer());
+
+	queue.add(Write{first_bad});
+	queue.add(Execute{kernel, {}, global});
+	queue.add(Read{first_bad});
+	queue.execute();
+
+	return Validation{first_bad[0] == count, static_cast<size_t>(first_bad[0])};
+}
+
+template<typename T>
+Validation deviceSorted(Context const& ct, Queue& queue, Buffer<T>& buf, bool descending = false){
+	cl_int count = buf.size() / sizeof(T);
+	cl_int desc = descending;
+
+	if(count < 2)
+		return Validation{true, static_cast<size_t>(count)};
+
+	Kernel kernel{ct.getProgram("validate.cl"), validate_kernel<T>::sorted};
+
+	kernel.addArgument(0, &buf.buffer());
+	kernel.addArgument(1, &count);
+	kernel.addArgument(2, &desc);
+
+	return runValidation(ct, queue, kernel, 3, {static_cast<size_t>(count - 1)}, count);
+}
+
+template<typename T>
+Validation deviceTransposed(Context const& ct, Queue& queue, Buffer<T>& A, size_t x, size_t y, size_t lda, Buffer<T>& B, size_t ldb){
+	cl_int X = x, Y = y, LDA = lda, LDB = ldb;
+
+	if(x == 0 || y == 0)
+		return Validation{true, 0};
+
+	Kernel kernel{ct.getProgram("validate.cl"), validate_kernel<T>::transposed};
+
+	kernel.addArgument(0, &A.buffer());
+	kernel.addArgument(1, &X);
+	kernel.addArgument(2, &Y);
+	kernel.addArgument(3, &LDA);
+	kernel.addArgument(4, &B.buffer());
+	kernel.addArgument(5, &LDB);
+
+	return runValidation(ct, queue, kernel, 6, {x, y}, X * Y);
+}
+
+template<typename T>
+Validation deviceIdentity(Context const& ct, Queue& queue, Buffer<T>& A, size_t n, size_t lda, T tolerance = T{}){
+	cl_int N = n, LDA = lda;
+
+	if(n == 0)
+		return Validation{true, 0};
+
+	Kernel kernel{ct.getProgram("validate.cl"), validate_kernel<T>::identity};
+
+	kernel.addArgument(0, &A.buffer());
+	kernel.addArgument(1, &N);
+	kernel.addArgument(2, &LDA);
+	kernel.addArgument(3, &tolerance);
+
+	return runValidation(ct, queue, kernel, 4, {n, n}, N * N);
+}
+
+}
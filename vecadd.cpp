@@ -19,7 +19,7 @@ enum{VEC_SIZE = 1024};
 int main(){
 
 
-	myfcl::Context context;
+	myfcl::Context context{myfcl::bestDevice()};
 
 	myfcl::Buffer<int> buf1{context, VEC_SIZE};
 	myfcl::Buffer<int> buf2{context, VEC_SIZE};
@@ -32,13 +32,14 @@ int main(){
 	}
 
 
-	myfcl::Queue queue{context};
+	// uploads, both kernels and both downloads are independent, scheduler lets them overlap
 
+	myfcl::Scheduler scheduler{context};
 
-	queue.addTask(new myfcl::Write{buf1});
-	queue.addTask(new myfcl::Write{buf2});
+	scheduler.write(buf1);
+	scheduler.write(buf2);
 
-	myfcl::Program prog_vec{context, "vector_add_kernel.cl"};
+	myfcl::Program const& prog_vec = context.getProgram("vector_add_kernel.cl");
 	myfcl::Kernel vec_add{prog_vec, "vector_add"};
 	myfcl::Kernel vec_diff{prog_vec, "vector_diff"};
 
@@ -53,11 +54,20 @@ int main(){
 	vec_diff.addArgument(2, &buf4.buffer());
 
 
-	queue.addTask(new myfcl::Execute{vec_add, {64}, {VEC_SIZE}});
+	scheduler.launch(vec_add, {64}, {VEC_SIZE}, {buf1.buffer(), buf2.buffer()}, {buf3.buffer()});
+	scheduler.launch(vec_diff, {64}, {VEC_SIZE}, {buf1.buffer(), buf2.buffer()}, {buf4.buffer()});
 
-	queue.addTask(new myfcl::Read{buf3});
+	scheduler.read(buf3);
+	scheduler.read(buf4);
+
+	scheduler.finish();
+
+	for(int i = 0; i < VEC_SIZE; i++)
+		if(buf3[i] != buf1[i] + buf2[i] || buf4[i] != buf1[i] - buf2[i]){
+			std::cout << "Wrong result at " << i << std::endl;
+			return -1;
+		}
 
-	queue.execute();
 	std::cout << "Done!" << std::endl;
 	std::cout << std::endl;
 }
\ No newline at end of file